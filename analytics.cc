@@ -0,0 +1,231 @@
+#include "analytics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "audio_util.h"
+#include "math.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    static const uint64_t kHashSeed = 0x6D70336861736821ull;
+
+    // BS.1770 loudness of a mean square
+    static inline double toLUFS(double energy) {
+        return -0.691 + 10 * std::log10(energy);
+    }
+
+    PCMAnalyzer::PCMAnalyzer(const AnalyzerConfig& config) : config(config) {
+        if (config.loudness) histogram.resize(kHistogramBins);
+
+        // 4x oversampling interpolator: windowed sinc cut off at the
+        // original Nyquist frequency
+        const int length = kTruePeakPhases * kTruePeakTaps;
+        double center = (length - 1) / 2.0;
+        for (int n = 0; n < length; n++) {
+            double x = (n - center) / kTruePeakPhases;
+            double sinc = x == 0 ? 1 : std::sin(util::math::M_PI * x) / (util::math::M_PI * x);
+            double t = 2 * util::math::M_PI * n / (length - 1);
+            double window = 0.42 - 0.5 * std::cos(t) + 0.08 * std::cos(2 * t);
+            true_peak_coefs[n % kTruePeakPhases][n / kTruePeakPhases] = (float)(sinc * window);
+        }
+        reset();
+    }
+
+    void PCMAnalyzer::reset() {
+        sample_rate = 0;
+        samples = 0;
+        sub_block_fill = 0;
+        sub_block_energy = 0;
+        sub_block_count = 0;
+        momentary_max = -1e300;
+        std::fill(histogram.begin(), histogram.end(), 0);
+        sample_peak = 0;
+        true_peak = 0;
+        memset(true_peak_history, 0, sizeof(true_peak_history));
+        rms_window_fill = 0;
+        rms_window_energy = 0;
+        rms_total_energy = 0;
+        envelope.clear();
+        hash_state = kHashSeed;
+        hash_word = 0;
+        hash_fill = 0;
+        hash_samples = 0;
+    }
+
+    // K-weighting filters for the given rate (pre-filter shelf and RLB
+    // high-pass from BS.1770, bilinear transformed)
+    void PCMAnalyzer::setRate(uint32_t rate) {
+        sample_rate = rate;
+
+        double f0 = 1681.974450955533;
+        double gain = 3.999843853973347;
+        double q = 0.7071752369554196;
+        double k = std::tan(util::math::M_PI * f0 / rate);
+        double vh = std::pow(10.0, gain / 20.0);
+        double vb = std::pow(vh, 0.4996667741545416);
+        double a0 = 1.0 + k / q + k * k;
+        shelf = Biquad{(vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                       2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0, {0, 0}, {0, 0}};
+
+        f0 = 38.13547087602444;
+        q = 0.5003270373238773;
+        k = std::tan(util::math::M_PI * f0 / rate);
+        a0 = 1.0 + k / q + k * k;
+        highpass = Biquad{1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0, {0, 0}, {0, 0}};
+
+        sub_block_length = rate / 10;
+        rms_window_length = max<uint32_t>(1, (uint32_t)((uint64_t)rate * config.rms_window_ms / 1000));
+    }
+
+    void PCMAnalyzer::addSamples(const float* const* in, uint32_t channels, uint32_t length, uint32_t rate) {
+        if (rate != sample_rate) setRate(rate);
+        if (config.loudness) addLoudness(in, channels, length);
+        if (config.true_peak) addTruePeak(in, channels, length);
+        if (config.rms) addRMS(in, channels, length);
+        samples += length;
+    }
+
+    void PCMAnalyzer::addLoudness(const float* const* in, uint32_t channels, uint32_t length) {
+        for (uint32_t i = 0; i < length; i++) {
+            for (uint32_t ch = 0; ch < channels; ch++) {
+                double y = highpass.run(ch, shelf.run(ch, in[ch][i]));
+                sub_block_energy += y * y;
+            }
+            if (++sub_block_fill < sub_block_length) continue;
+
+            // a 400 ms block ends every 100 ms once four sub-blocks are in
+            sub_blocks[sub_block_count++ % 4] = sub_block_energy / sub_block_length;
+            sub_block_energy = 0;
+            sub_block_fill = 0;
+            if (sub_block_count < 4) continue;
+            double energy = (sub_blocks[0] + sub_blocks[1] + sub_blocks[2] + sub_blocks[3]) / 4;
+            if (energy <= 0) continue;
+            double lufs = toLUFS(energy);
+            momentary_max = max(momentary_max, lufs);
+            if (lufs >= -70.0) {
+                int bin = min(kHistogramBins - 1, (int)((lufs + 70.0) * 100.0));
+                histogram[bin]++;
+            }
+        }
+    }
+
+    void PCMAnalyzer::addTruePeak(const float* const* in, uint32_t channels, uint32_t length) {
+        float peak = sample_peak;
+        float over_peak = true_peak;
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            float* history = true_peak_history[ch];
+            for (uint32_t i = 0; i < length; i++) {
+                float x = in[ch][i];
+                peak = max(peak, x < 0 ? -x : x);
+                memmove(history + 1, history, (kTruePeakTaps - 1) * sizeof(float));
+                history[0] = x;
+                for (int p = 0; p < kTruePeakPhases; p++) {
+                    float y = 0;
+                    for (int j = 0; j < kTruePeakTaps; j++)
+                        y += true_peak_coefs[p][j] * history[j];
+                    over_peak = max(over_peak, y < 0 ? -y : y);
+                }
+            }
+        }
+        sample_peak = peak;
+        true_peak = max(over_peak, peak);
+    }
+
+    void PCMAnalyzer::addRMS(const float* const* in, uint32_t channels, uint32_t length) {
+        for (uint32_t i = 0; i < length; i++) {
+            double energy = 0;
+            for (uint32_t ch = 0; ch < channels; ch++)
+                energy += (double)in[ch][i] * in[ch][i];
+            energy /= channels;
+            rms_window_energy += energy;
+            rms_total_energy += energy;
+            if (++rms_window_fill == rms_window_length) {
+                envelope.push_back((float)std::sqrt(rms_window_energy / rms_window_length));
+                rms_window_energy = 0;
+                rms_window_fill = 0;
+            }
+        }
+    }
+
+    void PCMAnalyzer::addPCM(const int16_t* pcm, size_t count) {
+        if (!config.hash) return;
+        hash_samples += count;
+        size_t i = 0;
+        // finish a partial word, then take whole words straight from the buffer
+        while (i < count && hash_fill != 0) {
+            hash_word |= (uint64_t)(uint16_t)pcm[i++] << (16 * hash_fill);
+            if (++hash_fill == 4) {
+                hash_state = mixWord(hash_state, hash_word);
+                hash_word = 0;
+                hash_fill = 0;
+            }
+        }
+        for (; i + 4 <= count; i += 4) {
+            uint64_t word = (uint64_t)(uint16_t)pcm[i] | (uint64_t)(uint16_t)pcm[i + 1] << 16
+                          | (uint64_t)(uint16_t)pcm[i + 2] << 32 | (uint64_t)(uint16_t)pcm[i + 3] << 48;
+            hash_state = mixWord(hash_state, word);
+        }
+        for (; i < count; i++) {
+            hash_word |= (uint64_t)(uint16_t)pcm[i] << (16 * hash_fill++);
+        }
+    }
+
+    // two-pass gating over the block histogram: -70 LUFS absolute, then
+    // 10 LU below the mean of what passed
+    double PCMAnalyzer::integratedLoudness() {
+        double sum = 0;
+        uint64_t count = 0;
+        for (int bin = 0; bin < kHistogramBins; bin++) {
+            if (!histogram[bin]) continue;
+            sum += histogram[bin] * std::pow(10.0, (-70.0 + (bin + 0.5) * 0.01 + 0.691) / 10.0);
+            count += histogram[bin];
+        }
+        if (count == 0) return -HUGE_VAL;
+
+        double threshold = toLUFS(sum / count) - 10.0;
+        int first = max(0, (int)((threshold + 70.0) * 100.0));
+        sum = 0;
+        count = 0;
+        for (int bin = first; bin < kHistogramBins; bin++) {
+            if (!histogram[bin]) continue;
+            sum += histogram[bin] * std::pow(10.0, (-70.0 + (bin + 0.5) * 0.01 + 0.691) / 10.0);
+            count += histogram[bin];
+        }
+        return count ? toLUFS(sum / count) : -HUGE_VAL;
+    }
+
+    AnalysisResult PCMAnalyzer::result() {
+        AnalysisResult result;
+        memset(&result, 0, sizeof(result));
+        result.samples = samples;
+        result.integrated_lufs = config.loudness ? integratedLoudness() : -HUGE_VAL;
+        result.momentary_max_lufs = sub_block_count >= 4 ? momentary_max : -HUGE_VAL;
+        result.replay_gain_db = std::isfinite(result.integrated_lufs) ? -18.0 - result.integrated_lufs : 0;
+        result.sample_peak = sample_peak;
+        result.true_peak = true_peak;
+        result.rms_db = samples && rms_total_energy > 0 ? 10 * std::log10(rms_total_energy / samples) : -HUGE_VAL;
+        result.rms_envelope = envelope.data();
+        result.rms_envelope_size = envelope.size();
+
+        // fold in the partial word and the length, then avalanche
+        uint64_t h = hash_state;
+        if (hash_fill) h = mixWord(h, hash_word);
+        h ^= hash_samples;
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        result.hash = config.hash ? h : 0;
+        return result;
+    }
+
+}
+
+}
+
+}
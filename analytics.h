@@ -0,0 +1,116 @@
+#ifndef INCLUDE_KERNEL_IO_ANALYTICS_H_
+#define INCLUDE_KERNEL_IO_ANALYTICS_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // which metrics a PCMAnalyzer computes
+    struct AnalyzerConfig {
+        bool loudness = true;   // EBU R128 / BS.1770 integrated and momentary loudness
+        bool true_peak = true;  // 4x oversampled peak
+        bool rms = true;        // RMS envelope and overall RMS
+        bool hash = true;       // hash of the int16 output, for deduplication
+        uint32_t rms_window_ms = 100;
+    };
+
+    struct AnalysisResult {
+        uint64_t samples;           // per channel
+        double integrated_lufs;     // -HUGE_VAL when every block is gated out
+        double momentary_max_lufs;  // loudest 400 ms block
+        double replay_gain_db;      // gain to bring the stream to -18 LUFS
+        float sample_peak;          // linear, 1.0 is full scale
+        float true_peak;
+        double rms_db;              // dBFS over the whole stream
+        const float* rms_envelope;  // linear RMS per rms_window_ms window
+        size_t rms_envelope_size;
+        uint64_t hash;              // not cryptographic
+    };
+
+    // Computes loudness, peaks, an RMS envelope and a content hash from the
+    // decoder's own buffers while they are in cache (attach it with
+    // MP3FrameDecoder::setAnalyzer), so none of them costs a pass over the
+    // decoded PCM. State is allocated up front except the envelope, which
+    // grows by one float per window.
+    class PCMAnalyzer {
+        // one biquad section per channel
+        struct Biquad {
+            double b0, b1, b2, a1, a2;
+            double z1[2], z2[2];
+            double run(uint32_t ch, double x) {
+                double y = b0 * x + z1[ch];
+                z1[ch] = b1 * x - a1 * y + z2[ch];
+                z2[ch] = b2 * x - a2 * y;
+                return y;
+            }
+        };
+
+        static const int kHistogramBins = 7500;  // 0.01 LU from -70 to +5 LUFS
+        static const int kTruePeakPhases = 4;
+        static const int kTruePeakTaps = 12;     // per phase
+
+        AnalyzerConfig config;
+        uint32_t sample_rate = 0;
+        uint64_t samples = 0;
+
+        // loudness: K-weighting, 100 ms sub-blocks, 400 ms blocks
+        Biquad shelf;
+        Biquad highpass;
+        uint32_t sub_block_length = 0;
+        uint32_t sub_block_fill = 0;
+        double sub_block_energy = 0;
+        double sub_blocks[4] = {0, 0, 0, 0};
+        uint64_t sub_block_count = 0;
+        double momentary_max = -1e300;
+        std::vector<uint32_t> histogram;
+
+        // peaks
+        float sample_peak = 0;
+        float true_peak = 0;
+        float true_peak_coefs[kTruePeakPhases][kTruePeakTaps];
+        float true_peak_history[2][kTruePeakTaps];
+
+        // RMS
+        uint32_t rms_window_length = 0;
+        uint32_t rms_window_fill = 0;
+        double rms_window_energy = 0;
+        double rms_total_energy = 0;
+        std::vector<float> envelope;
+
+        // hash, fed 64 bits at a time
+        uint64_t hash_state;
+        uint64_t hash_word = 0;
+        uint32_t hash_fill = 0;      // int16 samples in hash_word
+        uint64_t hash_samples = 0;
+
+        void setRate(uint32_t rate);
+        void addLoudness(const float* const* in, uint32_t channels, uint32_t length);
+        void addTruePeak(const float* const* in, uint32_t channels, uint32_t length);
+        void addRMS(const float* const* in, uint32_t channels, uint32_t length);
+        double integratedLoudness();
+
+    public:
+        PCMAnalyzer(const AnalyzerConfig& config = AnalyzerConfig());
+
+        // length samples of each channel in [-1, 1], as they leave synthesis
+        void addSamples(const float* const* in, uint32_t channels, uint32_t length, uint32_t rate);
+        // the int16 output, in order
+        void addPCM(const int16_t* pcm, size_t count);
+
+        AnalysisResult result();
+        void reset();
+    };
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_ANALYTICS_H_
@@ -2,6 +2,7 @@
 #define INCLUDE_KERNEL_IO_AUDIO_UTIL_H_
 
 #include "stdint.h"
+#include <cstring>
 #include "math.h"
 
 namespace io {
@@ -26,6 +27,28 @@ uint32_t readBitsInc(uint8_t* buffer, int* offset, int count);
 
 uint32_t readBits(uint8_t *buffer, int start_bit, int end_bit);
 
+// the count (at most 25) bits starting at bit, without advancing; always
+// loads the 4 bytes at bit / 8, so the buffer must be padded
+inline uint32_t peekBits(const uint8_t* data, int bit, int count) {
+    const uint8_t* p = data + (bit >> 3);
+    uint32_t word = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    return (word << (bit & 7)) >> (32 - count);
+}
+
+// folds the 64-bit word w into the running hash h (fast, not cryptographic)
+inline uint64_t mixWord(uint64_t h, uint64_t w) {
+    h ^= w * 0x9E3779B97F4A7C15ull;
+    return ((h << 27) | (h >> 37)) * 0x94D049BB133111EBull + 0x2545F4914F6CDD1Dull;
+}
+
+// at least 57 bits from bit on, the first in the top bit of the result;
+// loads the 8 bytes at bit / 8
+inline uint64_t peekWindow(const uint8_t* data, int bit) {
+    uint64_t word;
+    memcpy(&word, data + (bit >> 3), 8);
+    return __builtin_bswap64(word) << (bit & 7);
+}
+
 }
 
 }
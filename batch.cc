@@ -0,0 +1,248 @@
+#include "batch.h"
+#include "tables.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    template<uint32_t kLanes>
+    BatchDecoder<kLanes>::BatchDecoder() {
+        memset(prev_samples, 0, sizeof(prev_samples));
+        memset(fifo, 0, sizeof(fifo));
+        memset(lines, 0, sizeof(lines));
+        memset(block_type, 0, sizeof(block_type));
+        fifo_offset = 0;
+        for (uint32_t lane = 0; lane < kLanes; lane++) decoders[lane] = nullptr;
+    }
+
+    template<uint32_t kLanes>
+    void BatchDecoder<kLanes>::attach(uint32_t lane, MP3FrameDecoder* decoder) {
+        decoders[lane] = decoder;
+        if (decoder) loadLane(lane);
+    }
+
+    template<uint32_t kLanes>
+    void BatchDecoder<kLanes>::detach(uint32_t lane) {
+        if (decoders[lane]) storeLane(lane);
+        decoders[lane] = nullptr;
+    }
+
+    template<uint32_t kLanes>
+    void BatchDecoder<kLanes>::loadLane(uint32_t lane) {
+        MP3FrameDecoder* decoder = decoders[lane];
+        for (int ch = 0; ch < 2; ch++) {
+            for (int sb = 0; sb < 32; sb++)
+                for (int i = 0; i < 18; i++) prev_samples[ch][sb][i][lane] = decoder->prev_samples[ch][sb][i];
+            for (uint32_t i = 0; i < 1024; i++) fifo[ch][(fifo_offset + i) & 1023][lane] = decoder->fifo[ch][i];
+        }
+    }
+
+    template<uint32_t kLanes>
+    void BatchDecoder<kLanes>::storeLane(uint32_t lane) {
+        MP3FrameDecoder* decoder = decoders[lane];
+        for (int ch = 0; ch < 2; ch++) {
+            for (int sb = 0; sb < 32; sb++)
+                for (int i = 0; i < 18; i++) decoder->prev_samples[ch][sb][i] = prev_samples[ch][sb][i][lane];
+            for (uint32_t i = 0; i < 1024; i++) decoder->fifo[ch][i] = fifo[ch][(fifo_offset + i) & 1023][lane];
+        }
+    }
+
+    // runs the lane's decoder up to the IMDCT input and copies that into
+    // the lane; false if the frame's main data is not in the reservoir
+    template<uint32_t kLanes>
+    bool BatchDecoder<kLanes>::unpackLane(uint32_t lane, uint8_t* frame) {
+        MP3FrameDecoder* decoder = decoders[lane];
+        decoder->bindScratch();
+        decoder->setSideInfo(frame + 4 + (decoder->header->protection_bit ? 0 : 2));
+        if (!decoder->setMainData(frame)) return false;
+
+        for (int gr = 0; gr < 2; gr++) {
+            decoder->requantizeGranule(gr);
+            for (int ch = 0; ch < 2; ch++) {
+                const GranuleSideInfo& granule = decoder->side_info->granule[gr][ch];
+                const float* samples = decoder->samples[gr][ch];
+                block_type[gr][ch][lane] = granule.block_type;
+                if (granule.block_type == 2 || granule.mixed_block_flag) {
+                    // reorder while interleaving
+                    const uint16_t* source = decoder->reorder_source;
+                    for (int i = 0; i < 576; i++) lines[gr][ch][i][lane] = source[i] < 576 ? samples[source[i]] : 0.0f;
+                } else {
+                    decoder->aliasReduction(gr, ch);
+                    for (int i = 0; i < 576; i++) lines[gr][ch][i][lane] = samples[i];
+                }
+            }
+        }
+        return true;
+    }
+
+    // imdctSubband (mp3.cc) across the lanes of one group, followed by
+    // frequency inversion; the arithmetic per lane is the same, in the same
+    // order. Element e of the group is at e * kGroups (as Lanes) from its base.
+    template<uint32_t kLanes>
+    void BatchDecoder<kLanes>::IMDCT(uint32_t gr, uint32_t ch, uint32_t group) {
+        Lanes window[36];
+        LaneMask is_short;
+        bool any_short = false, all_short = true;
+        for (uint32_t i = 0; i < kGroupLanes; i++) {
+            uint32_t type = block_type[gr][ch][group * kGroupLanes + i];
+            for (int j = 0; j < 36; j++) window[j][i] = kIMDCTTables.window[type][j];
+            is_short[i] = type == 2 ? -1 : 0;
+            any_short |= type == 2;
+            all_short &= type == 2;
+        }
+
+        const Lanes* in = (const Lanes*)lines[gr][ch] + group;
+        Lanes* out = (Lanes*)time + group;
+        Lanes* prev = (Lanes*)prev_samples[ch] + group;
+        const Lanes zero = {};
+
+        for (int sb = 0; sb < 32; sb++, in += 18 * kGroups, out += 18 * kGroups, prev += 18 * kGroups) {
+            Lanes sample_block[36];
+            if (!all_short) {
+                for (int i = 0; i < 36; i++) {
+                    const float* cos = kIMDCTTables.long_cos[i];
+                    Lanes xi = zero;
+                    for (int k = 0; k < 18; k++) xi += in[k * kGroups] * cos[k];
+                    sample_block[i] = xi * window[i];
+                }
+            }
+
+            if (any_short) {
+                Lanes temp_block[36];
+                for (int win = 0; win < 3; win++)
+                    for (int i = 0; i < 12; i++) {
+                        const float* cos = kIMDCTTables.short_cos[i];
+                        Lanes xi = zero;
+                        for (int k = 0; k < 6; k++) xi += in[(6 * win + k) * kGroups] * cos[k];
+                        temp_block[win * 12 + i] = xi * kIMDCTTables.window[2][i];
+                    }
+
+                Lanes short_block[36];
+                int i = 0;
+                for (; i < 6; i++)
+                    short_block[i] = zero;
+                for (; i < 12; i++)
+                    short_block[i] = temp_block[i - 6];
+                for (; i < 18; i++)
+                    short_block[i] = temp_block[i - 6] + temp_block[i];
+                for (; i < 24; i++)
+                    short_block[i] = temp_block[i] + temp_block[i + 6];
+                for (; i < 30; i++)
+                    short_block[i] = temp_block[i + 6];
+                for (; i < 36; i++)
+                    short_block[i] = zero;
+
+                for (i = 0; i < 36; i++)
+                    sample_block[i] = all_short ? short_block[i] : (is_short ? short_block[i] : sample_block[i]);
+            }
+
+            for (int i = 0; i < 18; i++) {
+                out[i * kGroups] = sample_block[i] + prev[i * kGroups];
+                prev[i * kGroups] = sample_block[18 + i];
+            }
+            if (sb & 1) {
+                for (int i = 1; i < 18; i += 2) out[i * kGroups] *= -1.0f;
+            }
+        }
+    }
+
+    // synthFilterbank (mp3.cc) across the lanes of one group: the FIFO
+    // shift becomes a move of the ring offset, and the windowed sum reads
+    // the FIFO directly
+    template<uint32_t kLanes>
+    void BatchDecoder<kLanes>::synthFilterbank(uint32_t gr, uint32_t ch, uint32_t group) {
+        const Lanes* in = (const Lanes*)time + group;
+        Lanes* out = (Lanes*)lines[gr][ch] + group;
+        Lanes* ring = (Lanes*)fifo[ch] + group;
+        const Lanes zero = {};
+
+        uint32_t offset = (fifo_offset - gr * 18 * 64) & 1023;
+        for (int sb = 0; sb < 18; sb++) {
+            Lanes s[32];
+            for (int i = 0; i < 32; i++)
+                s[i] = in[(i * 18 + sb) * kGroups];
+
+            offset = (offset - 64) & 1023;
+            Lanes* v = ring + offset * kGroups;
+            for (int i = 0; i < 64; i++) {
+                Lanes sum = zero;
+                for (int j = 0; j < 32; j++)
+                    sum += s[j] * kSynthTables.cos[i][j];
+                v[i * kGroups] = sum;
+            }
+
+            // u[j * 32 + i] of the scalar version; no 32-sample run wraps
+            for (int i = 0; i < 32; i++) {
+                Lanes sum = zero;
+                for (int j = 0; j < 16; j++) {
+                    uint32_t at = (offset + (j >> 1) * 128 + (j & 1) * 96 + i) & 1023;
+                    sum += ring[at * kGroups] * kSynthWindow[j * 32 + i];
+                }
+                out[(32 * sb + i) * kGroups] = sum;
+            }
+        }
+    }
+
+    template<uint32_t kLanes>
+    void BatchDecoder<kLanes>::decodeFrames(uint8_t* const* frames, int16_t* const* out, uint32_t* lengths) {
+        // lanes sitting this frame out are swapped out around it, since the
+        // batch advances every lane's state
+        bool decoded[kLanes];
+        for (uint32_t lane = 0; lane < kLanes; lane++) {
+            decoded[lane] = false;
+            lengths[lane] = 0;
+            MP3FrameDecoder* decoder = decoders[lane];
+            if (!decoder || !frames[lane]) continue;
+
+            MP3FrameHeader header = loadHeader(frames[lane]);
+            // other versions and layers would be misparsed as layer III
+            if (!header.isDecodable()) continue;
+            decoder->getHeader(frames[lane]);
+            lengths[lane] = header.frameLength();
+            decoded[lane] = unpackLane(lane, frames[lane]);
+            if (!decoded[lane]) memset(out[lane], 0, 2304 * sizeof(int16_t));
+        }
+        for (uint32_t lane = 0; lane < kLanes; lane++) {
+            if (decoded[lane]) continue;
+            if (decoders[lane]) storeLane(lane);
+            // run silence through the idle lane rather than stale values
+            for (int gr = 0; gr < 2; gr++)
+                for (int ch = 0; ch < 2; ch++) {
+                    block_type[gr][ch][lane] = 0;
+                    for (int i = 0; i < 576; i++) lines[gr][ch][i][lane] = 0;
+                }
+        }
+
+        for (uint32_t group = 0; group < kGroups; group++)
+            for (int gr = 0; gr < 2; gr++)
+                for (int ch = 0; ch < 2; ch++) {
+                    IMDCT(gr, ch, group);
+                    synthFilterbank(gr, ch, group);
+                }
+        fifo_offset = (fifo_offset - 2 * 18 * 64) & 1023;
+
+        for (uint32_t lane = 0; lane < kLanes; lane++) {
+            if (!decoders[lane]) continue;
+            if (!decoded[lane]) {
+                loadLane(lane);
+                continue;
+            }
+            int16_t* pcm = out[lane];
+            for (int gr = 0; gr < 2; gr++)
+                for (int i = 0; i < 576; i++)
+                    for (int ch = 0; ch < 2; ch++)
+                        *pcm++ = scalePCM(lines[gr][ch][i][lane]);
+        }
+    }
+
+    template class BatchDecoder<4>;
+    template class BatchDecoder<8>;
+    template class BatchDecoder<16>;
+
+}
+
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef INCLUDE_KERNEL_IO_BATCH_H_
+#define INCLUDE_KERNEL_IO_BATCH_H_
+
+#include "stdint.h"
+#include "mp3.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // lanes one SIMD register holds on the target
+#if defined(__AVX512F__)
+    static const uint32_t kNativeLanes = 16;
+#elif defined(__AVX__)
+    static const uint32_t kNativeLanes = 8;
+#else
+    static const uint32_t kNativeLanes = 4;
+#endif
+
+    // GCC vector types holding one float (or lane mask) per lane
+    template<uint32_t kLanes> struct LaneTypes;
+    template<> struct LaneTypes<4> {
+        typedef float Lanes __attribute__((vector_size(16)));
+        typedef int32_t Mask __attribute__((vector_size(16)));
+    };
+    template<> struct LaneTypes<8> {
+        typedef float Lanes __attribute__((vector_size(32)));
+        typedef int32_t Mask __attribute__((vector_size(32)));
+    };
+    template<> struct LaneTypes<16> {
+        typedef float Lanes __attribute__((vector_size(64)));
+        typedef int32_t Mask __attribute__((vector_size(64)));
+    };
+
+    // Decodes kLanes independent streams in lockstep, one per SIMD lane
+    // (instantiated for 4, 8 and 16). Each stream's own MP3FrameDecoder
+    // still parses its frames and requantizes them (side info, bit
+    // reservoir, Huffman, requantize, stereo, alias reduction); the
+    // spectra are then interleaved lane by lane and the IMDCT and synthesis
+    // filterbank run once for all lanes, a register's worth of lanes (a
+    // group) at a time. Lanes whose block types differ are handled by
+    // computing the long and short IMDCT and picking per lane.
+    //
+    // While a decoder is attached, its overlap and synthesis state live
+    // here in structure-of-arrays form and its own copies are stale; detach
+    // copies them back, so a stream can move between batches (or back to
+    // decodeFrame) at any frame boundary. Output is the same PCM decodeFrame
+    // produces. Decoders with a resampler or analyzer are not supported.
+    template<uint32_t kLanes>
+    class BatchDecoder {
+        static const uint32_t kGroupLanes = kLanes < kNativeLanes ? kLanes : kNativeLanes;
+        static const uint32_t kGroups = kLanes / kGroupLanes;
+        typedef typename LaneTypes<kGroupLanes>::Lanes Lanes;
+        typedef typename LaneTypes<kGroupLanes>::Mask LaneMask;
+
+        // overlap and synthesis FIFO of every lane; the FIFO is a ring
+        // whose logical sample 0 is at fifo_offset, shared by all lanes
+        alignas(64) float prev_samples [2][32][18][kLanes];
+        alignas(64) float fifo [2][1024][kLanes];
+        uint32_t fifo_offset;
+
+        // the current frame's spectra, in IMDCT input order; synthesis
+        // writes each granule's PCM back over them
+        alignas(64) float lines [2][2][576][kLanes];
+        // IMDCT output of one granule and channel
+        alignas(64) float time [576][kLanes];
+        uint8_t block_type [2][2][kLanes];
+
+        MP3FrameDecoder* decoders [kLanes];
+
+        void loadLane(uint32_t lane);
+        void storeLane(uint32_t lane);
+        bool unpackLane(uint32_t lane, uint8_t* frame);
+        void IMDCT(uint32_t granule, uint32_t channel, uint32_t group);
+        void synthFilterbank(uint32_t granule, uint32_t channel, uint32_t group);
+
+    public:
+        static const uint32_t lanes = kLanes;
+
+        BatchDecoder();
+
+        // binds decoder to lane (replacing what was there without saving
+        // it) and takes over its overlap and synthesis state
+        void attach(uint32_t lane, MP3FrameDecoder* decoder);
+        // hands the lane's state back to its decoder and empties the lane
+        void detach(uint32_t lane);
+        MP3FrameDecoder* decoder(uint32_t lane) { return decoders[lane]; }
+
+        // Decodes the frame at frames[lane] into out[lane] (2304 samples)
+        // for every attached lane; lengths[lane] gets the frame's length,
+        // or 0 if the lane is empty, frames[lane] is nullptr or the frame
+        // is not an MPEG-1 layer III frame (frames must be complete).
+        // Lanes that do not decode a frame keep their state, as do lanes
+        // whose bit reservoir lacks the frame's main data (their output is
+        // silence, as with decodeFrame).
+        void decodeFrames(uint8_t* const* frames, int16_t* const* out, uint32_t* lengths);
+    };
+
+    extern template class BatchDecoder<4>;
+    extern template class BatchDecoder<8>;
+    extern template class BatchDecoder<16>;
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_BATCH_H_
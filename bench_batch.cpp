@@ -0,0 +1,140 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include "batch.h"
+#include "probe.h"
+
+using namespace io::audio::mp3;
+
+// Decodes N streams of the test file (each starting at a different frame)
+// on one thread, first one stream at a time with decodeFrame, then in
+// lockstep with BatchDecoder at 4, 8 and 16 lanes, and reports aggregate
+// frames per second and whether every frame's PCM matched. Every 50
+// frames the batched streams are detached and re-attached one lane over,
+// the way a server would regroup them.
+// usage: bench_batch [streams] [frames per stream] [file]
+
+static uint64_t hashPCM(const int16_t* pcm, size_t count) {
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ (uint16_t)pcm[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+struct Corpus {
+    std::vector<uint8_t> file;
+    std::vector<size_t> frames;
+};
+
+// per-stream frame offsets: stream s starts at frame 37 * s
+static size_t frameAt(const Corpus& corpus, int stream, int frame) {
+    return corpus.frames[(37 * stream + frame) % corpus.frames.size()];
+}
+
+static double decodeScalar(Corpus& corpus, int streams, int frames, std::vector<uint64_t>* hashes) {
+    std::vector<MP3FrameDecoder*> decoders(streams);
+    for (int s = 0; s < streams; s++) decoders[s] = new MP3FrameDecoder();
+    std::vector<int16_t> pcm(2304);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++)
+        for (int s = 0; s < streams; s++) {
+            uint8_t* frame = &corpus.file[frameAt(corpus, s, f)];
+            decoders[s]->getHeader(frame);
+            decoders[s]->decodeFrame(frame, pcm.data());
+            (*hashes)[s * frames + f] = hashPCM(pcm.data(), 2304);
+        }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (int s = 0; s < streams; s++) delete decoders[s];
+    return seconds;
+}
+
+template<uint32_t kLanes>
+static void decodeBatched(Corpus& corpus, int streams, int frames, const std::vector<uint64_t>& expected,
+                          double scalar_seconds) {
+    int num_batches = (streams + kLanes - 1) / kLanes;
+    std::vector<MP3FrameDecoder*> decoders(streams);
+    for (int s = 0; s < streams; s++) decoders[s] = new MP3FrameDecoder();
+    std::vector<BatchDecoder<kLanes>*> batches(num_batches);
+    for (int b = 0; b < num_batches; b++) batches[b] = new BatchDecoder<kLanes>();
+
+    std::vector<int16_t> pcm(kLanes * 2304);
+    int16_t* out[kLanes];
+    for (uint32_t lane = 0; lane < kLanes; lane++) out[lane] = &pcm[lane * 2304];
+    uint8_t* frame_ptrs[kLanes];
+    uint32_t lengths[kLanes];
+    int lane_stream[kLanes];
+    uint64_t mismatches = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        if (f % 50 == 0) {
+            // regroup: stream s goes to slot (s + f / 50) of the batches
+            for (int b = 0; b < num_batches; b++)
+                for (uint32_t lane = 0; lane < kLanes; lane++) batches[b]->detach(lane);
+            for (int s = 0; s < streams; s++) {
+                int slot = (s + f / 50) % (num_batches * kLanes);
+                batches[slot / kLanes]->attach(slot % kLanes, decoders[s]);
+            }
+        }
+        for (int b = 0; b < num_batches; b++) {
+            BatchDecoder<kLanes>* batch = batches[b];
+            for (uint32_t lane = 0; lane < kLanes; lane++) {
+                lane_stream[lane] = -1;
+                frame_ptrs[lane] = nullptr;
+                MP3FrameDecoder* decoder = batch->decoder(lane);
+                if (!decoder) continue;
+                for (int s = 0; s < streams; s++)
+                    if (decoders[s] == decoder) lane_stream[lane] = s;
+                frame_ptrs[lane] = &corpus.file[frameAt(corpus, lane_stream[lane], f)];
+            }
+            batch->decodeFrames(frame_ptrs, out, lengths);
+            for (uint32_t lane = 0; lane < kLanes; lane++) {
+                if (lane_stream[lane] < 0) continue;
+                if (hashPCM(out[lane], 2304) != expected[lane_stream[lane] * frames + f]) mismatches++;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("  %2u lanes: %8.0f frames/s  %.2fx  %s\n", kLanes, streams * frames / seconds,
+           scalar_seconds / seconds, mismatches ? "MISMATCH" : "identical");
+    if (mismatches) printf("    %llu frames differ\n", (unsigned long long)mismatches);
+
+    for (int b = 0; b < num_batches; b++) delete batches[b];
+    for (int s = 0; s < streams; s++) delete decoders[s];
+}
+
+int main(int argc, char** argv) {
+    int streams = argc > 1 ? atoi(argv[1]) : 64;
+    int frames = argc > 2 ? atoi(argv[2]) : 200;
+    const char* path = argc > 3 ? argv[3] : "../test.mp3";
+
+    Corpus corpus;
+    std::ifstream ifs(path, std::ifstream::binary);
+    corpus.file.assign((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    MP3Info info;
+    if (!probe(corpus.file.data(), corpus.file.size(), &info)) {
+        printf("could not find MP3 frames in %s\n", path);
+        return 1;
+    }
+    for (size_t offset = info.audio_start; offset + 4 <= info.audio_end;) {
+        MP3FrameHeader header = loadHeader(&corpus.file[offset]);
+        if (!header.isValid() || offset + header.frameLength() > info.audio_end) break;
+        corpus.frames.push_back(offset);
+        offset += header.frameLength();
+    }
+
+    std::vector<uint64_t> expected(streams * frames);
+    double scalar = decodeScalar(corpus, streams, frames, &expected);
+    printf("%d streams x %d frames, one thread\n", streams, frames);
+    printf("  per stream: %8.0f frames/s\n", streams * frames / scalar);
+    decodeBatched<4>(corpus, streams, frames, expected, scalar);
+    decodeBatched<8>(corpus, streams, frames, expected, scalar);
+    decodeBatched<16>(corpus, streams, frames, expected, scalar);
+    return 0;
+}
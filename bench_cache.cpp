@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "pcm_cache.h"
+
+using namespace io::audio::mp3;
+
+// Serves random clips of the test file from several threads, the way a
+// preview or scrubbing service would: clip starts are skewed towards the
+// beginning of the track and a few "files" (the same data under different
+// ids) are hot. Runs once with decodeRange and once through a PCMCache,
+// and reports requests per second, the cache counters and whether every
+// clip matched the same samples of a full decode.
+// usage: bench_cache [threads] [requests per thread] [cache MB] [file]
+
+struct Request {
+    uint64_t file;
+    uint64_t start;
+};
+
+int main(int argc, char** argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 4;
+    int requests = argc > 2 ? atoi(argv[2]) : 200;
+    size_t cache_mb = argc > 3 ? atoi(argv[3]) : 64;
+    const char* path = argc > 4 ? argv[4] : "../test.mp3";
+    const int kFiles = 4;
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    FrameIndex index;
+    if (!buildFrameIndex(file.data(), file.size(), &index)) {
+        printf("could not find MP3 frames in %s\n", path);
+        return 1;
+    }
+    uint64_t total = index.numSamples();
+    std::vector<int16_t> full;
+    decodeRange(file.data(), file.size(), 0, total, &full, &index);
+
+    // one second clips, the same request list for both runs
+    uint64_t clip = index.sampling_rate;
+    std::vector<std::vector<Request>> lists(threads);
+    for (int t = 0; t < threads; t++) {
+        std::mt19937_64 rng(t + 1);
+        std::geometric_distribution<int> pick_file(0.5);
+        std::exponential_distribution<double> pick_start(4.0);
+        for (int r = 0; r < requests; r++) {
+            uint64_t start = (uint64_t)(std::min(pick_start(rng), 1.0) * (total - clip));
+            lists[t].push_back({(uint64_t)(pick_file(rng) % kFiles), start});
+        }
+    }
+
+    PCMCacheConfig config;
+    config.max_bytes = cache_mb << 20;
+    PCMCache cache(config);
+    for (int cached = 0; cached < 2; cached++) {
+        std::vector<uint64_t> mismatches(threads, 0);
+        std::vector<uint64_t> frames(threads, 0);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; t++)
+            workers.emplace_back([&, t]() {
+                std::vector<int16_t> out;
+                for (const Request& request : lists[t]) {
+                    RangeResult result = cached
+                        ? cache.decodeRange(request.file, file.data(), index, request.start, request.start + clip, &out)
+                        : decodeRange(file.data(), file.size(), request.start, request.start + clip, &out, &index);
+                    frames[t] += result.frames_decoded;
+                    if (result.status != RangeStatus::kOk
+                        || memcmp(out.data(), &full[request.start * 2], result.samples * 2 * sizeof(int16_t)) != 0)
+                        mismatches[t]++;
+                }
+            });
+        for (std::thread& worker : workers) worker.join();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t bad = 0, decoded = 0;
+        for (int t = 0; t < threads; t++) bad += mismatches[t], decoded += frames[t];
+        printf("%-12s %8.0f requests/s, %llu frames decoded, %s\n", cached ? "cached:" : "decodeRange:",
+               threads * requests / seconds, (unsigned long long)decoded, bad ? "MISMATCH" : "identical");
+        if (bad) printf("  %llu clips differ\n", (unsigned long long)bad);
+    }
+
+    PCMCacheStats stats = cache.stats();
+    printf("  hit rate %.1f%% (%llu hits, %llu misses: %llu resumed, %llu prerolled)\n", stats.hitRate() * 100,
+           (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.resumed,
+           (unsigned long long)stats.prerolled);
+    printf("  %llu chunks, %.1f MB, %llu evictions\n", (unsigned long long)stats.chunks,
+           stats.bytes / 1048576.0, (unsigned long long)stats.evictions);
+    return 0;
+}
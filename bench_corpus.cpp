@@ -0,0 +1,213 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "corpus_reader.h"
+#include "mp3.h"
+#include "probe.h"
+
+using namespace io::audio::mp3;
+
+// Decodes a list of files on N worker threads with the input coming from
+// the io_uring reader, the pread fallback, or per-frame ifstream reads the
+// way main.cpp does it, starting each run from a cold page cache.
+// usage: bench_corpus [uring|pread|ifstream|all] [--workers N] [--depth D]
+//                     [--frames F] [--copies N] [files...]
+//   --copies N makes N copies of ../test.mp3 under /tmp to use as the corpus
+//   --frames F decodes at most F frames per file (0: all); the reader modes
+//   still load each file whole, the ifstream mode stops reading there
+
+struct RunStats {
+    std::atomic<uint64_t> files{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> wait_ns{0}; // workers blocked on input
+};
+
+static uint64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// drop the files from the page cache so every run reads from the device
+static void evict(const std::vector<std::string>& paths) {
+    for (const std::string& path : paths) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+static uint32_t decodeBuffer(uint8_t* data, size_t size, uint32_t max_frames, int16_t* pcm, size_t pcm_size) {
+    MP3Info info;
+    if (!probe(data, size, &info)) return 0;
+    MP3FrameDecoder decoder;
+    uint64_t offset = info.first_frame;
+    uint32_t frames = 0;
+    while (offset < info.audio_end && (max_frames == 0 || frames < max_frames)) {
+        uint32_t batch = pcm_size / 2304;
+        if (max_frames) batch = min(batch, max_frames - frames);
+        DecodeResult result = decoder.decodeFrames(data + offset, info.audio_end - offset, pcm, pcm_size, batch);
+        if (result.frames == 0) break;
+        frames += result.frames;
+        offset += result.bytes_consumed;
+    }
+    return frames;
+}
+
+static void readerWorker(CorpusReader* reader, uint32_t max_frames, RunStats* stats) {
+    std::vector<int16_t> pcm(2304 * 16);
+    LoadedFile file;
+    while (true) {
+        uint64_t start = nowNs();
+        bool more = reader->next(&file);
+        stats->wait_ns += nowNs() - start;
+        if (!more) break;
+        if (file.ok) {
+            stats->frames += decodeBuffer(file.data, file.size, max_frames, pcm.data(), pcm.size());
+            stats->bytes += file.size;
+            stats->files++;
+        }
+        reader->release(file);
+    }
+}
+
+// the main.cpp loop: a 4 byte read for the header, then one for the rest
+static void ifstreamWorker(const std::vector<std::string>* paths, std::atomic<size_t>* next,
+                           uint32_t max_frames, RunStats* stats) {
+    uint8_t data[4096];
+    int16_t pcm[2304];
+    while (true) {
+        size_t index = (*next)++;
+        if (index >= paths->size()) break;
+        uint64_t wait = 0;
+        uint64_t start = nowNs();
+        std::ifstream ifs((*paths)[index], std::ifstream::binary);
+        ID3 id3;
+        ifs.read((char*)&id3, sizeof(id3));
+        ifs.seekg(id3.isID3() ? id3.tagSize() : 0);
+        wait += nowNs() - start;
+
+        MP3FrameDecoder decoder;
+        uint32_t frames = 0;
+        while (max_frames == 0 || frames < max_frames) {
+            start = nowNs();
+            ifs.read((char*)data, 4);
+            if (ifs.fail()) break;
+            decoder.getHeader(data);
+            if (!decoder.header->isValid()) break;
+            ifs.read((char*)(data + 4), decoder.header->frameLength() - 4);
+            wait += nowNs() - start;
+            if (ifs.fail()) break;
+            decoder.decodeFrame(data, pcm);
+            frames++;
+        }
+        stats->wait_ns += wait;
+        stats->frames += frames;
+        stats->bytes += (uint64_t)ifs.tellg() > 0 ? (uint64_t)ifs.tellg() : 0;
+        stats->files++;
+    }
+}
+
+static void run(const std::string& mode, const std::vector<std::string>& paths, int num_workers,
+                uint32_t depth, uint32_t max_frames) {
+    evict(paths);
+    RunStats stats;
+    std::vector<std::thread> workers;
+    uint64_t start = nowNs();
+    const char* backend = mode.c_str();
+
+    if (mode == "ifstream") {
+        std::atomic<size_t> next{0};
+        for (int i = 0; i < num_workers; i++) {
+            workers.emplace_back(ifstreamWorker, &paths, &next, max_frames, &stats);
+        }
+        for (auto& worker : workers) worker.join();
+    } else {
+        CorpusReaderConfig config;
+        config.queue_depth = depth;
+        config.use_io_uring = mode == "uring";
+        CorpusReader reader(paths, config);
+        if (mode == "uring" && !reader.usingIoUring()) backend = "uring (unavailable, pread)";
+        for (int i = 0; i < num_workers; i++) {
+            workers.emplace_back(readerWorker, &reader, max_frames, &stats);
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    double seconds = (nowNs() - start) / 1e9;
+    double wait = stats.wait_ns / 1e9;
+    printf("%-28s files %4llu  %8.1f MB  %7llu frames  %7.2f s  %7.1f MB/s  input wait %6.2f s (%4.1f%% of worker time)\n",
+           backend, (unsigned long long)stats.files.load(), stats.bytes / 1e6,
+           (unsigned long long)stats.frames.load(), seconds, stats.bytes / 1e6 / seconds,
+           wait, 100.0 * wait / (seconds * num_workers));
+}
+
+int main(int argc, char** argv) {
+    std::string mode = "all";
+    int num_workers = 4;
+    uint32_t depth = 64;
+    uint32_t max_frames = 0;
+    int copies = 0;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--workers" && has_value) {
+            num_workers = atoi(argv[++i]);
+        } else if (arg == "--depth" && has_value) {
+            depth = atoi(argv[++i]);
+        } else if (arg == "--frames" && has_value) {
+            max_frames = atoi(argv[++i]);
+        } else if (arg == "--copies" && has_value) {
+            copies = atoi(argv[++i]);
+        } else if (arg == "uring" || arg == "pread" || arg == "ifstream" || arg == "all") {
+            mode = arg;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    if (copies > 0) {
+        std::ifstream ifs("../test.mp3", std::ifstream::binary);
+        std::vector<char> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        if (file.empty()) {
+            printf("could not read ../test.mp3\n");
+            return 1;
+        }
+        for (int i = 0; i < copies; i++) {
+            std::string path = "/tmp/bench_corpus_" + std::to_string(i) + ".mp3";
+            std::ofstream ofs(path, std::ofstream::binary);
+            ofs.write(file.data(), file.size());
+            paths.push_back(path);
+        }
+    }
+    if (paths.empty()) {
+        printf("no input files (pass paths or --copies N)\n");
+        return 1;
+    }
+
+    printf("%zu files, %d workers, queue depth %u, %u frames per file\n",
+           paths.size(), num_workers, depth, max_frames);
+    if (mode == "all") {
+        run("ifstream", paths, num_workers, depth, max_frames);
+        run("pread", paths, num_workers, depth, max_frames);
+        run("uring", paths, num_workers, depth, max_frames);
+    } else {
+        run(mode, paths, num_workers, depth, max_frames);
+    }
+
+    if (copies > 0) {
+        for (const std::string& path : paths) unlink(path.c_str());
+    }
+    return 0;
+}
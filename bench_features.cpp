@@ -0,0 +1,139 @@
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include "features.h"
+#include "mp3.h"
+#include "probe.h"
+
+using namespace io::audio::mp3;
+
+// Compares band energies taken straight from the MDCT lines
+// (extractFeatures) with the usual decode-to-PCM-then-FFT route over the
+// same frames, and reports how similar the two mel spectrograms are.
+// usage: bench_features [frames] [file]
+
+static void fft(std::vector<std::complex<float>>& data) {
+    size_t n = data.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+    for (size_t length = 2; length <= n; length <<= 1) {
+        float angle = -2 * 3.14159265f / length;
+        std::complex<float> step(std::cos(angle), std::sin(angle));
+        for (size_t i = 0; i < n; i += length) {
+            std::complex<float> w(1);
+            for (size_t k = 0; k < length / 2; k++) {
+                std::complex<float> a = data[i + k];
+                std::complex<float> b = data[i + k + length / 2] * w;
+                data[i + k] = a + b;
+                data[i + k + length / 2] = a - b;
+                w *= step;
+            }
+        }
+    }
+}
+
+static double seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    uint32_t max_frames = argc > 1 ? atoi(argv[1]) : 1000;
+    const char* path = argc > 2 ? argv[2] : "../test.mp3";
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    MP3Info info;
+    if (!probe(file.data(), file.size(), &info)) {
+        printf("could not find MP3 frames in %s\n", path);
+        return 1;
+    }
+    size_t size = info.audio_end - info.first_frame;
+    uint8_t* input = &file[info.first_frame];
+    FeatureConfig config;
+    config.decibels = false;
+
+    // MDCT domain
+    std::vector<GranuleFeatures> mdct(2 * max_frames);
+    auto start = std::chrono::steady_clock::now();
+    {
+        MP3FrameDecoder* decoder = new MP3FrameDecoder();
+        FeatureExtractor extractor(config);
+        decoder->extractFeatures(input, size, extractor, mdct.data(), mdct.size());
+        delete decoder;
+    }
+    double mdct_time = seconds(start);
+
+    // decode, then a 1024 point Hann-windowed FFT every 576 samples, folded
+    // to 576 lines so the same extractor groups them
+    std::vector<GranuleFeatures> pcm_features(2 * max_frames);
+    start = std::chrono::steady_clock::now();
+    double decode_time;
+    {
+        MP3FrameDecoder* decoder = new MP3FrameDecoder();
+        std::vector<int16_t> pcm(2304 * max_frames);
+        DecodeResult result = decoder->decodeFrames(input, size, pcm.data(), pcm.size(), max_frames);
+        decode_time = seconds(start);
+        uint32_t channels = decoder->header->channels();
+        uint32_t rate = decoder->header->getSamplingRate();
+        const unsigned* band_index = decoder->band_index.long_win;
+        delete decoder;
+
+        FeatureExtractor extractor(config);
+        std::vector<std::complex<float>> buffer(1024);
+        float power[576];
+        size_t length = result.samples / channels;
+        for (size_t gr = 0; gr < pcm_features.size(); gr++) {
+            for (int i = 0; i < 1024; i++) {
+                size_t at = gr * 576 + i;
+                float x = 0;
+                if (at < length) {
+                    for (uint32_t ch = 0; ch < channels; ch++) x += pcm[at * channels + ch];
+                    x /= channels * 32768.0f;
+                }
+                buffer[i] = x * (0.5f - 0.5f * std::cos(2 * 3.14159265f * i / 1023));
+            }
+            fft(buffer);
+            for (int k = 0; k < 576; k++) {
+                // FFT bin k * 512 / 576 covers line k
+                std::complex<float> bin = buffer[k * 512 / 576];
+                power[k] = std::norm(bin);
+            }
+            extractor.extract(power, rate, band_index, false, &pcm_features[gr]);
+        }
+    }
+    double fft_time = seconds(start);
+
+    // correlation of log mel energies, a rough check that both routes see the
+    // same spectrogram
+    double sum_a = 0, sum_b = 0, sum_ab = 0, sum_aa = 0, sum_bb = 0;
+    size_t n = 0;
+    for (size_t gr = 0; gr < mdct.size(); gr++) {
+        for (uint32_t b = 0; b < mdct[gr].num_bands; b++) {
+            double a = std::log10(mdct[gr].bands[b] + 1e-12);
+            double c = std::log10(pcm_features[gr].bands[b] + 1e-12);
+            sum_a += a;
+            sum_b += c;
+            sum_ab += a * c;
+            sum_aa += a * a;
+            sum_bb += c * c;
+            n++;
+        }
+    }
+    double correlation = (n * sum_ab - sum_a * sum_b)
+                       / std::sqrt((n * sum_aa - sum_a * sum_a) * (n * sum_bb - sum_b * sum_b));
+
+    printf("granules: %zu\n", mdct.size());
+    printf("mdct features:      %.3f s\n", mdct_time);
+    printf("decode + fft:       %.3f s (decode %.3f s, fft %.3f s)\n", fft_time, decode_time, fft_time - decode_time);
+    printf("speedup:            %.1fx\n", fft_time / mdct_time);
+    printf("log mel correlation: %.3f\n", correlation);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <malloc.h>
+#include <vector>
+#include "mp3.h"
+#include "probe.h"
+
+using namespace io::audio::mp3;
+
+// Reports how many bytes each concurrent stream costs: N decoders are
+// created and each decodes a few frames of the test file, round robin,
+// the way a server interleaves its streams on one thread.
+// usage: bench_footprint [streams] [file]
+int main(int argc, char** argv) {
+    int num_streams = argc > 1 ? atoi(argv[1]) : 10000;
+    const char* path = argc > 2 ? argv[2] : "../test.mp3";
+    const int frames_per_stream = 4;
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    MP3Info info;
+    if (!probe(file.data(), file.size(), &info)) {
+        printf("could not find MP3 frames in %s\n", path);
+        return 1;
+    }
+
+    // shared state (Huffman trees, this thread's scratch) is not per stream;
+    // the first frame the process decodes also pays for building it
+    std::vector<int16_t> out(2304 * frames_per_stream);
+    double frame_us[2];
+    {
+        MP3FrameDecoder warmup;
+        size_t offset = info.first_frame;
+        for (int i = 0; i < 2; i++) {
+            auto start = std::chrono::steady_clock::now();
+            DecodeResult result = warmup.decodeFrames(&file[offset], file.size() - offset, out.data(), out.size(), 1);
+            frame_us[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            offset += result.bytes_consumed;
+        }
+    }
+
+    size_t before = mallinfo2().uordblks;
+    std::vector<MP3FrameDecoder*> decoders(num_streams);
+    std::vector<size_t> offsets(num_streams, info.first_frame);
+    for (int i = 0; i < num_streams; i++) {
+        decoders[i] = new MP3FrameDecoder();
+    }
+    for (int frame = 0; frame < frames_per_stream; frame++) {
+        for (int i = 0; i < num_streams; i++) {
+            DecodeResult result = decoders[i]->decodeFrames(&file[offsets[i]], file.size() - offsets[i],
+                                                            out.data(), out.size(), 1);
+            offsets[i] += result.bytes_consumed;
+        }
+    }
+    size_t after = mallinfo2().uordblks;
+
+    double per_stream = (double)(after - before) / num_streams;
+    printf("streams: %d\n", num_streams);
+    printf("sizeof(MP3FrameDecoder): %zu\n", sizeof(MP3FrameDecoder));
+    printf("heap bytes per stream: %.0f\n", per_stream);
+    printf("shared scratch per thread: %zu\n", sizeof(DecoderScratch));
+    printf("projected for 50000 streams: %.1f MB\n", per_stream * 50000 / (1 << 20));
+    printf("first frame: %.0f us, second frame: %.0f us\n", frame_us[0], frame_us[1]);
+
+    for (int i = 0; i < num_streams; i++) {
+        delete decoders[i];
+    }
+    return 0;
+}
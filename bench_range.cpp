@@ -0,0 +1,63 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "probe.h"
+#include "range.h"
+
+using namespace io::audio::mp3;
+
+// Decodes the whole file once, then cuts clips of the given length out of
+// it at several positions with decodeRange, with and without a frame
+// index, and reports the time per clip and whether it matches the same
+// samples of the full decode.
+// usage: bench_range [clip seconds] [file]
+
+int main(int argc, char** argv) {
+    double clip_seconds = argc > 1 ? atof(argv[1]) : 5;
+    const char* path = argc > 2 ? argv[2] : "../test.mp3";
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    FrameIndex index;
+    auto start = std::chrono::steady_clock::now();
+    if (!buildFrameIndex(file.data(), file.size(), &index)) {
+        printf("could not find MP3 frames in %s\n", path);
+        return 1;
+    }
+    double index_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // reference: every sample of the stream, decoded from the first frame
+    uint64_t total = index.numSamples();
+    std::vector<int16_t> full;
+    start = std::chrono::steady_clock::now();
+    decodeRange(file.data(), file.size(), 0, total, &full, &index);
+    double full_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%llu samples, %zu frames: index %.2f ms, full decode %.1f ms\n",
+           (unsigned long long)total, index.numFrames(), index_ms, full_ms);
+
+    uint64_t clip = (uint64_t)(clip_seconds * index.sampling_rate);
+    std::vector<int16_t> out;
+    bool all_match = true;
+    for (int i = 0; i <= 8; i++) {
+        uint64_t begin = (total - min(clip, total)) * i / 8;
+        // an odd offset so the clip starts inside a frame
+        if (begin + 333 + clip <= total) begin += 333;
+        double ms[2];
+        RangeResult result;
+        for (int with_index = 0; with_index < 2; with_index++) {
+            start = std::chrono::steady_clock::now();
+            result = decodeRange(file.data(), file.size(), begin, begin + clip, &out, with_index ? &index : nullptr);
+            ms[with_index] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            bool match = result.status == RangeStatus::kOk
+                && memcmp(out.data(), &full[begin * 2], result.samples * 2 * sizeof(int16_t)) == 0;
+            all_match &= match;
+        }
+        printf("  at %6.1f s: %.2f ms, %.2f ms with index (%u primed, %u decoded)\n",
+               (double)begin / index.sampling_rate, ms[0], ms[1], result.frames_primed, result.frames_decoded);
+    }
+    printf("%s\n", all_match ? "all clips identical to the full decode" : "MISMATCH");
+    return all_match ? 0 : 1;
+}
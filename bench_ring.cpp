@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <vector>
+#include "pcm_ring.h"
+
+using namespace io::audio::mp3;
+
+// Plays the test file to a simulated audio callback that asks for one
+// block every period, first decoding each block synchronously when it is
+// asked for (PCMGenerator) and then reading it from a PCMRing filled by
+// its decode thread. Reports the time from asking to having the block
+// (mean, p50, p99, p99.9, max and its standard deviation as jitter), how
+// often the ring was empty when asked, and whether both played the same PCM.
+// usage: bench_ring [blocks] [period us] [file]
+
+typedef std::chrono::steady_clock Clock;
+
+struct Timings {
+    std::vector<double> us;
+    uint64_t hash = 1469598103934665603ull;
+    uint32_t underruns = 0;
+};
+
+static void consume(const PCMBlock& block, Timings* timings) {
+    const int16_t* samples = block.samples;
+    for (uint32_t i = 0; i < block.length * block.channels; i++)
+        timings->hash = (timings->hash ^ (uint16_t)samples[i]) * 1099511628211ull;
+}
+
+static void report(const char* name, Timings& timings) {
+    std::vector<double>& us = timings.us;
+    std::sort(us.begin(), us.end());
+    double sum = 0, squares = 0;
+    for (double t : us) sum += t, squares += t * t;
+    double mean = sum / us.size();
+    auto at = [&](double p) { return us[std::min(us.size() - 1, (size_t)(p * us.size()))]; };
+    printf("%-6s mean %7.2f  p50 %7.2f  p99 %7.2f  p99.9 %7.2f  max %7.2f  jitter %7.2f us",
+           name, mean, at(0.5), at(0.99), at(0.999), us.back(), std::sqrt(squares / us.size() - mean * mean));
+    if (timings.underruns) printf("  (%u empty)", timings.underruns);
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    int blocks = argc > 1 ? atoi(argv[1]) : 3000;
+    int period_us = argc > 2 ? atoi(argv[2]) : 1000;
+    const char* path = argc > 3 ? argv[3] : "../test.mp3";
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    printf("%d blocks, one every %d us\n", blocks, period_us);
+
+    Timings sync;
+    {
+        MemorySource source(file.data(), file.size());
+        PCMGenerator pcm = decodePCM(source);
+        auto tick = Clock::now();
+        for (int i = 0; i < blocks; i++) {
+            tick += std::chrono::microseconds(period_us);
+            std::this_thread::sleep_until(tick);
+            auto start = Clock::now();
+            if (!pcm.next()) break;
+            sync.us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+            consume(pcm.block(), &sync);
+        }
+    }
+
+    Timings ring;
+    {
+        MemorySource source(file.data(), file.size());
+        PCMRing pcm(source);
+        pcm.start();
+        auto tick = Clock::now();
+        for (int i = 0; i < blocks; i++) {
+            tick += std::chrono::microseconds(period_us);
+            std::this_thread::sleep_until(tick);
+            auto start = Clock::now();
+            const PCMBlock* block = pcm.peek();
+            if (!block) {
+                ring.underruns++;
+                block = pcm.wait();
+            }
+            if (!block) break;
+            ring.us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+            consume(*block, &ring);
+            pcm.pop();
+        }
+    }
+
+    report("sync:", sync);
+    report("ring:", ring);
+    printf("%s\n", sync.hash == ring.hash && sync.us.size() == ring.us.size() ? "same PCM" : "MISMATCH");
+    return 0;
+}
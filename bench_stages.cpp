@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <vector>
+#include "mp3.h"
+#include "probe.h"
+
+using namespace io::audio::mp3;
+
+// Runs the decoder one stage at a time (the order decodeFrame uses) and
+// reports how long each stage takes per frame, best of several passes
+// over the file. Each stage is timed around every call, which adds a few
+// tens of ns per call. A second decoder then runs the same frames through
+// transformGranule, the fused form of requantize through synthesis, for
+// comparison with the sum of those stages.
+// usage: bench_stages [passes] [file]
+
+enum Stage {
+    kSideInfo = 0,
+    kMainData,
+    kScalefacs,
+    kHuffman,
+    kRequantize,
+    kStereo,
+    kReorderAlias,
+    kIMDCT,
+    kSynthesis,
+    kInterleave,
+    kNumStages,
+};
+
+static const char* kStageNames[kNumStages] = {
+    "side info", "bit reservoir", "scalefactors", "huffman", "requantize",
+    "stereo", "reorder/alias", "imdct", "synthesis", "interleave",
+};
+
+int main(int argc, char** argv) {
+    int passes = argc > 1 ? atoi(argv[1]) : 5;
+    const char* path = argc > 2 ? argv[2] : "../test.mp3";
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    MP3Info info;
+    if (!probe(file.data(), file.size(), &info)) {
+        printf("could not find MP3 frames in %s\n", path);
+        return 1;
+    }
+    std::vector<size_t> frames;
+    for (size_t offset = info.audio_start; offset + 4 <= info.audio_end;) {
+        MP3FrameHeader header = loadHeader(&file[offset]);
+        if (!header.isValid() || offset + header.frameLength() > info.audio_end) break;
+        frames.push_back(offset);
+        offset += header.frameLength();
+    }
+
+    double best[kNumStages];
+    for (int i = 0; i < kNumStages; i++) best[i] = 1e30;
+    double best_fused = 1e30;
+    std::vector<int16_t> out(2304);
+
+    using clock = std::chrono::steady_clock;
+    for (int pass = 0; pass < passes; pass++) {
+        double total[kNumStages] = {};
+        clock::time_point last;
+        auto lap = [&](Stage stage) {
+            clock::time_point now = clock::now();
+            total[stage] += std::chrono::duration<double, std::nano>(now - last).count();
+            last = now;
+        };
+
+        MP3FrameDecoder* decoder = new MP3FrameDecoder();
+        for (size_t offset : frames) {
+            uint8_t* frame = &file[offset];
+            decoder->getHeader(frame);
+            MP3FrameHeader* header = decoder->header;
+            MP3SideInfo* side_info = decoder->side_info;
+            uint32_t channels = header->channels();
+
+            last = clock::now();
+            decoder->setSideInfo(frame + 4 + (header->protection_bit ? 0 : 2));
+            lap(kSideInfo);
+            bool ok = decoder->loadMainData(frame);
+            lap(kMainData);
+            if (!ok) continue;
+
+            int bit = 0;
+            for (int gr = 0; gr < 2; gr++)
+                for (uint32_t ch = 0; ch < channels; ch++) {
+                    int max_bit = bit + side_info->granule[gr][ch].part2_3_length;
+                    last = clock::now();
+                    decoder->unpackScalefacs(decoder->main_data, gr, ch, bit);
+                    lap(kScalefacs);
+                    decoder->unpackSamples(decoder->main_data, gr, ch, bit, max_bit);
+                    lap(kHuffman);
+                    bit = max_bit;
+                }
+
+            for (int gr = 0; gr < 2; gr++) {
+                last = clock::now();
+                for (uint32_t ch = 0; ch < channels; ch++) decoder->requantize(gr, ch);
+                lap(kRequantize);
+                if (header->channel_mode == 1 && (header->mode_extension >> 1)) decoder->midSideStereo(gr);
+                lap(kStereo);
+                for (uint32_t ch = 0; ch < channels; ch++) {
+                    if (side_info->granule[gr][ch].block_type == 2 || side_info->granule[gr][ch].mixed_block_flag) {
+                        decoder->reorder(gr, ch);
+                    } else {
+                        decoder->aliasReduction(gr, ch);
+                    }
+                    lap(kReorderAlias);
+                    decoder->IMDCT(gr, ch);
+                    decoder->frequencyInversion(gr, ch);
+                    lap(kIMDCT);
+                    decoder->synthFilterbank(gr, ch);
+                    lap(kSynthesis);
+                }
+            }
+            decoder->interleave(out.data());
+            lap(kInterleave);
+        }
+        delete decoder;
+
+        double fused = 0;
+        decoder = new MP3FrameDecoder();
+        for (size_t offset : frames) {
+            uint8_t* frame = &file[offset];
+            decoder->getHeader(frame);
+            decoder->setSideInfo(frame + 4 + (decoder->header->protection_bit ? 0 : 2));
+            if (!decoder->setMainData(frame)) continue;
+            clock::time_point start = clock::now();
+            decoder->transformGranule(0);
+            decoder->transformGranule(1);
+            fused += std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        }
+        delete decoder;
+
+        for (int i = 0; i < kNumStages; i++) {
+            best[i] = std::min(best[i], total[i] / frames.size());
+        }
+        best_fused = std::min(best_fused, fused / frames.size());
+    }
+
+    double sum = 0;
+    for (int i = 0; i < kNumStages; i++) sum += best[i];
+    printf("%zu frames, ns per frame:\n", frames.size());
+    for (int i = 0; i < kNumStages; i++) {
+        printf("  %-14s %9.0f  %5.1f%%\n", kStageNames[i], best[i], 100 * best[i] / sum);
+    }
+    printf("  %-14s %9.0f\n", "total", sum);
+
+    double staged = 0;
+    for (int i = kRequantize; i <= kSynthesis; i++) staged += best[i];
+    printf("requantize..synthesis: staged %.0f, fused %.0f ns per frame\n", staged, best_fused);
+    return 0;
+}
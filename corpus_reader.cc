@@ -0,0 +1,322 @@
+#include "corpus_reader.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "audio_util.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    static int ioUringSetup(unsigned entries, io_uring_params* params) {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    static int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    CorpusReader::CorpusReader(const std::vector<std::string>& paths, const CorpusReaderConfig& config)
+        : config(config), paths(paths) {
+        if (this->config.queue_depth == 0) this->config.queue_depth = 1;
+        if (this->config.max_open_files == 0) this->config.max_open_files = 1;
+        uring = config.use_io_uring && setupRing();
+    }
+
+    CorpusReader::~CorpusReader() {
+        // drain whatever is still in flight so the kernel stops writing into our buffers
+        while (uring && in_flight > 0) {
+            reap(true);
+        }
+        for (PendingFile* file : active) {
+            close(file->fd);
+            free(file->data);
+            delete file;
+        }
+        for (LoadedFile& file : ready) {
+            free(file.data);
+        }
+        teardownRing();
+    }
+
+    bool CorpusReader::setupRing() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = ioUringSetup(config.queue_depth, &params);
+        if (fd < 0) return false;
+        ring.fd = fd;
+
+        // IORING_OP_READ arrived in 5.6, one release before FAST_POLL; older
+        // kernels take the pread path
+        if (!(params.features & IORING_FEAT_FAST_POLL)) {
+            teardownRing();
+            return false;
+        }
+
+        ring.sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            ring.sq_size = ring.cq_size = max(ring.sq_size, ring.cq_size);
+        }
+
+        ring.sq_ptr = mmap(nullptr, ring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (ring.sq_ptr == MAP_FAILED) {
+            ring.sq_ptr = nullptr;
+            teardownRing();
+            return false;
+        }
+        if (single_mmap) {
+            ring.cq_ptr = ring.sq_ptr;
+        } else {
+            ring.cq_ptr = mmap(nullptr, ring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (ring.cq_ptr == MAP_FAILED) {
+                ring.cq_ptr = nullptr;
+                teardownRing();
+                return false;
+            }
+        }
+        ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        ring.sqes_ptr = mmap(nullptr, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (ring.sqes_ptr == MAP_FAILED) {
+            ring.sqes_ptr = nullptr;
+            teardownRing();
+            return false;
+        }
+
+        uint8_t* sq = (uint8_t*)ring.sq_ptr;
+        uint8_t* cq = (uint8_t*)ring.cq_ptr;
+        ring.sq_head = (unsigned*)(sq + params.sq_off.head);
+        ring.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+        ring.sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+        ring.sq_array = (unsigned*)(sq + params.sq_off.array);
+        ring.cq_head = (unsigned*)(cq + params.cq_off.head);
+        ring.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+        ring.cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+        ring.cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+        ring.sqes = (io_uring_sqe*)ring.sqes_ptr;
+
+        // never have more in flight than the submission queue holds
+        config.queue_depth = min(config.queue_depth, params.sq_entries);
+        return true;
+    }
+
+    void CorpusReader::teardownRing() {
+        if (ring.sqes_ptr) munmap(ring.sqes_ptr, ring.sqes_size);
+        if (ring.cq_ptr && ring.cq_ptr != ring.sq_ptr) munmap(ring.cq_ptr, ring.cq_size);
+        if (ring.sq_ptr) munmap(ring.sq_ptr, ring.sq_size);
+        if (ring.fd >= 0) close(ring.fd);
+        ring = Ring();
+    }
+
+    // opens the next file in the list and allocates its buffer; files that
+    // can't be opened go straight to the ready queue as failed
+    CorpusReader::PendingFile* CorpusReader::openNext() {
+        size_t index = next_path++;
+        files_held++;
+
+        PendingFile* file = new PendingFile{index, -1, nullptr, 0, 0, 0, false};
+        struct stat st;
+        file->fd = open(paths[index].c_str(), O_RDONLY);
+        if (file->fd < 0 || fstat(file->fd, &st) != 0) {
+            file->failed = true;
+        } else {
+            file->size = st.st_size;
+            file->data = (uint8_t*)malloc(file->size ? file->size : 1);
+        }
+        active.push_back(file);
+        if (file->failed || file->size == 0) {
+            finish(file);
+            return nullptr;
+        }
+        return file;
+    }
+
+    void CorpusReader::finish(PendingFile* file) {
+        for (auto it = active.begin(); it != active.end(); ++it) {
+            if (*it == file) {
+                active.erase(it);
+                break;
+            }
+        }
+        if (file->fd >= 0) close(file->fd);
+        ready.push_back(LoadedFile{file->index, paths[file->index].c_str(), file->data, file->size, !file->failed});
+        delete file;
+    }
+
+    void CorpusReader::submit(Request* request) {
+        unsigned tail = *ring.sq_tail;
+        unsigned index = tail & *ring.sq_mask;
+        io_uring_sqe* sqe = &ring.sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = request->file->fd;
+        sqe->addr = (uint64_t)(request->file->data + request->offset);
+        sqe->len = request->length;
+        sqe->off = request->offset;
+        sqe->user_data = (uint64_t)request;
+        ring.sq_array[index] = index;
+        // the kernel must see the entry before the new tail
+        __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+        to_submit++;
+        in_flight++;
+    }
+
+    // queues reads until queue_depth are in flight, opening files as needed
+    void CorpusReader::fill() {
+        while (in_flight < config.queue_depth) {
+            PendingFile* file = nullptr;
+            for (PendingFile* candidate : active) {
+                if (candidate->next_offset < candidate->size) {
+                    file = candidate;
+                    break;
+                }
+            }
+            if (!file) {
+                if (files_held >= config.max_open_files || next_path >= paths.size()) return;
+                openNext();
+                continue;
+            }
+
+            uint32_t length = (uint32_t)min<uint64_t>(config.block_size, file->size - file->next_offset);
+            submit(new Request{file, file->next_offset, length});
+            file->next_offset += length;
+            file->reads_in_flight++;
+        }
+    }
+
+    // hands queued reads to the kernel without waiting for any
+    void CorpusReader::flush() {
+        if (to_submit == 0) return;
+        int ret = ioUringEnter(ring.fd, to_submit, 0, 0);
+        if (ret > 0) to_submit -= min<unsigned>(ret, to_submit);
+    }
+
+    void CorpusReader::reap(bool wait) {
+        if (to_submit > 0 || wait) {
+            int ret = ioUringEnter(ring.fd, to_submit, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0);
+            if (ret > 0) to_submit -= min<unsigned>(ret, to_submit);
+        }
+
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe* cqe = &ring.cqes[head & *ring.cq_mask];
+            Request* request = (Request*)cqe->user_data;
+            int res = cqe->res;
+            head++;
+            in_flight--;
+
+            PendingFile* file = request->file;
+            if (res == -EAGAIN || res == -EINTR) {
+                submit(request);
+                continue;
+            }
+            if (res > 0 && (uint32_t)res < request->length) {
+                // short read: ask for the rest
+                request->offset += res;
+                request->length -= res;
+                submit(request);
+                continue;
+            }
+            if (res <= 0) {
+                // an error, or the file shrank under us; submit nothing more
+                // for it and finish it once its other reads are back
+                file->failed = true;
+                file->next_offset = file->size;
+            }
+            delete request;
+            file->reads_in_flight--;
+            if (file->reads_in_flight == 0 && file->next_offset == file->size) {
+                finish(file);
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    bool CorpusReader::readWhole(LoadedFile* out) {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (next_path >= paths.size()) return false;
+            index = next_path++;
+        }
+
+        *out = LoadedFile{index, paths[index].c_str(), nullptr, 0, false};
+        int fd = open(out->path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) close(fd);
+            return true;
+        }
+        out->size = st.st_size;
+        out->data = (uint8_t*)malloc(out->size ? out->size : 1);
+        size_t done = 0;
+        while (done < out->size) {
+            ssize_t ret = pread(fd, out->data + done, min<size_t>(config.block_size, out->size - done), done);
+            if (ret <= 0) break;
+            done += ret;
+        }
+        out->ok = done == out->size;
+        close(fd);
+        return true;
+    }
+
+    bool CorpusReader::next(LoadedFile* out) {
+        if (!uring) return readWhole(out);
+
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            // while a worker waits on the ring only it takes completions, so
+            // the completion it waits for can't be taken from under it
+            if (!reaping) reap(false);
+            fill();
+            flush();
+            if (!ready.empty()) {
+                *out = ready.front();
+                ready.pop_front();
+                return true;
+            }
+            if (in_flight == 0 && active.empty() && next_path >= paths.size()) return false;
+            if (in_flight == 0 || reaping) {
+                // every file slot is held by a worker, or another worker is
+                // already waiting on the ring; wait for a release or its reap
+                changed.wait(guard);
+                continue;
+            }
+
+            // wait for the disk without the lock, so other workers can take
+            // ready files and release theirs meanwhile
+            reaping = true;
+            guard.unlock();
+            ioUringEnter(ring.fd, 0, 1, IORING_ENTER_GETEVENTS);
+            guard.lock();
+            reaping = false;
+            reap(false);
+            changed.notify_all();
+        }
+    }
+
+    void CorpusReader::release(LoadedFile& file) {
+        free(file.data);
+        file.data = nullptr;
+        if (uring) {
+            std::lock_guard<std::mutex> guard(lock);
+            files_held--;
+        }
+        changed.notify_one();
+    }
+
+}
+
+}
+
+}
@@ -0,0 +1,123 @@
+#ifndef INCLUDE_KERNEL_IO_CORPUS_READER_H_
+#define INCLUDE_KERNEL_IO_CORPUS_READER_H_
+
+#include "stdint.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    struct CorpusReaderConfig {
+        uint32_t queue_depth = 64;      // reads kept in flight
+        uint32_t block_size = 1 << 18;  // bytes per read
+        uint32_t max_open_files = 16;   // files being read or waiting for a worker (bounds memory)
+        bool use_io_uring = true;       // false forces the pread path
+    };
+
+    // a file that has been read completely; data stays valid until release()
+    struct LoadedFile {
+        size_t index;      // position in the path list
+        const char* path;
+        uint8_t* data;
+        size_t size;
+        bool ok;           // false if the file could not be opened or read
+    };
+
+    // Reads a list of files whole, keeping queue_depth reads in flight across
+    // up to max_open_files files with io_uring (raw syscalls, no liburing),
+    // and hands out files as they complete. Where io_uring is unavailable
+    // (old kernel, seccomp, io_uring_disabled) files are read with pread.
+    // next() and release() may be called from any number of worker threads;
+    // one of them at a time waits on the ring, without holding the lock.
+    class CorpusReader {
+        struct PendingFile {
+            size_t index;
+            int fd;
+            uint8_t* data;
+            uint64_t size;
+            uint64_t next_offset;     // first byte not yet submitted
+            uint32_t reads_in_flight;
+            bool failed;
+        };
+
+        struct Request {
+            PendingFile* file;
+            uint64_t offset;
+            uint32_t length;
+        };
+
+        // the parts of the kernel's rings we touch
+        struct Ring {
+            int fd = -1;
+            void* sq_ptr = nullptr;
+            size_t sq_size = 0;
+            void* cq_ptr = nullptr;
+            size_t cq_size = 0;
+            void* sqes_ptr = nullptr;
+            size_t sqes_size = 0;
+            unsigned* sq_head;
+            unsigned* sq_tail;
+            unsigned* sq_mask;
+            unsigned* sq_array;
+            unsigned* cq_head;
+            unsigned* cq_tail;
+            unsigned* cq_mask;
+            io_uring_sqe* sqes;
+            io_uring_cqe* cqes;
+        };
+
+        CorpusReaderConfig config;
+        std::vector<std::string> paths;
+        size_t next_path = 0;
+        uint32_t files_held = 0; // pending + ready + handed out
+        uint32_t in_flight = 0;
+        uint32_t to_submit = 0;
+        bool uring = false;
+        bool reaping = false;    // a worker is waiting on the ring without the lock
+        Ring ring;
+
+        std::mutex lock;
+        std::condition_variable changed; // a file was released or reads were reaped
+        std::deque<PendingFile*> active;
+        std::deque<LoadedFile> ready;
+
+        bool setupRing();
+        void teardownRing();
+        PendingFile* openNext();
+        void finish(PendingFile* file);
+        void submit(Request* request);
+        void fill();
+        void flush();
+        void reap(bool wait);
+        bool readWhole(LoadedFile* out);
+
+    public:
+        CorpusReader(const std::vector<std::string>& paths, const CorpusReaderConfig& config);
+        ~CorpusReader();
+
+        bool usingIoUring() { return uring; }
+
+        // the next completely read file (not necessarily in list order);
+        // false once every file has been handed out
+        bool next(LoadedFile* out);
+        void release(LoadedFile& file);
+    };
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_CORPUS_READER_H_
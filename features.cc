@@ -0,0 +1,101 @@
+#include "features.h"
+#include <cmath>
+#include <cstring>
+#include "audio_util.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    static double toMel(double hz) {
+        return 2595.0 * std::log10(1.0 + hz / 700.0);
+    }
+
+    FeatureExtractor::FeatureExtractor(const FeatureConfig& config) : config(config) {
+        this->config.mel_bands = max<uint32_t>(1, min(config.mel_bands, kMaxFeatureBands));
+    }
+
+    void FeatureExtractor::setRate(uint32_t rate, const unsigned* long_band_index) {
+        sample_rate = rate;
+        double line_hz = rate / 2.0 / 576.0;
+
+        for (int i = 0; i < 576; i++) {
+            double hz = (i + 0.5) * line_hz;
+
+            if (config.layout == BandLayout::kScalefactor) {
+                int band = 0;
+                while (band < 21 && (unsigned)i >= long_band_index[band + 1]) band++;
+                line_band[i] = band;
+                line_weight[i] = 0;
+            } else {
+                // position between the centers of neighbouring mel bands
+                double position = toMel(hz) / toMel(rate / 2.0) * config.mel_bands - 0.5;
+                if (position < 0) {
+                    line_band[i] = 0;
+                    line_weight[i] = 0;
+                } else if (position >= config.mel_bands - 1) {
+                    line_band[i] = config.mel_bands - 1;
+                    line_weight[i] = 0;
+                } else {
+                    line_band[i] = (int16_t)position;
+                    line_weight[i] = (float)(position - line_band[i]);
+                }
+            }
+
+            // below ~55 Hz lines are wider than a semitone; above 5 kHz
+            // harmonics dominate
+            if (hz < 55.0 || hz > 5000.0) {
+                pitch_class[i] = -1;
+            } else {
+                int midi = (int)std::lround(12.0 * std::log2(hz / 440.0) + 69.0);
+                pitch_class[i] = (int8_t)(midi % 12);
+            }
+        }
+    }
+
+    void FeatureExtractor::extract(const float* power, uint32_t rate, const unsigned* long_band_index,
+                                   bool short_blocks, GranuleFeatures* out) {
+        if (rate != sample_rate) setRate(rate, long_band_index);
+
+        uint32_t num_bands = config.layout == BandLayout::kScalefactor ? 22 : config.mel_bands;
+        out->index = granules++;
+        out->sample_rate = rate;
+        out->num_bands = num_bands;
+        out->short_blocks = short_blocks;
+        memset(out->bands, 0, sizeof(out->bands));
+        memset(out->chroma, 0, sizeof(out->chroma));
+
+        float energy = 0;
+        for (int i = 0; i < 576; i++) {
+            float p = power[i];
+            energy += p;
+            int band = line_band[i];
+            float weight = line_weight[i];
+            out->bands[band] += p * (1 - weight);
+            if (weight > 0) out->bands[band + 1] += p * weight;
+            if (config.chroma && pitch_class[i] >= 0) out->chroma[pitch_class[i]] += p;
+        }
+        out->energy = energy;
+
+        if (config.chroma) {
+            float total = 0;
+            for (int i = 0; i < 12; i++) total += out->chroma[i];
+            if (total > 0) {
+                for (int i = 0; i < 12; i++) out->chroma[i] /= total;
+            }
+        }
+        if (config.decibels) {
+            for (uint32_t b = 0; b < num_bands; b++) {
+                out->bands[b] = 10.0f * std::log10(out->bands[b] + 1e-10f);
+            }
+            out->energy = 10.0f * std::log10(energy + 1e-10f);
+        }
+    }
+
+}
+
+}
+
+}
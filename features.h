@@ -0,0 +1,70 @@
+#ifndef INCLUDE_KERNEL_IO_FEATURES_H_
+#define INCLUDE_KERNEL_IO_FEATURES_H_
+
+#include "stdint.h"
+#include <cstddef>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // how the 576 spectral lines of a granule are grouped
+    enum class BandLayout {
+        kMel = 0,     // triangular bands evenly spaced on the mel scale
+        kScalefactor, // the 22 long-block scalefactor bands of the stream's rate
+    };
+
+    static const uint32_t kMaxFeatureBands = 64;
+
+    struct FeatureConfig {
+        BandLayout layout = BandLayout::kMel;
+        uint32_t mel_bands = 40;   // at most kMaxFeatureBands
+        bool chroma = true;
+        bool decibels = true;      // 10 * log10 of the energies instead of linear power
+    };
+
+    // features of one granule (576 samples per channel), channels mixed
+    struct GranuleFeatures {
+        uint64_t index;       // granule number in the stream
+        uint32_t sample_rate;
+        uint32_t num_bands;
+        float bands[kMaxFeatureBands];
+        float chroma[12];     // C, C#, ... B, normalized to sum to 1 (all 0 when silent)
+        float energy;         // total
+        bool short_blocks;    // the granule used short windows (coarser frequency resolution)
+    };
+
+    // Turns the power spectrum of a granule, taken from the requantized MDCT
+    // lines, into band energies and a chroma vector. Used by
+    // MP3FrameDecoder::extractFeatures, which skips the IMDCT and synthesis.
+    class FeatureExtractor {
+        FeatureConfig config;
+        uint32_t sample_rate = 0;
+        uint64_t granules = 0;
+
+        // each line adds (1 - weight) of its power to band and weight to band + 1
+        int16_t line_band[576];
+        float line_weight[576];
+        int8_t pitch_class[576]; // -1 outside the range chroma uses
+
+        void setRate(uint32_t rate, const unsigned* long_band_index);
+
+    public:
+        FeatureExtractor(const FeatureConfig& config = FeatureConfig());
+
+        // power holds 576 lines; long_band_index is the stream's long block
+        // scalefactor band table
+        void extract(const float* power, uint32_t rate, const unsigned* long_band_index,
+                     bool short_blocks, GranuleFeatures* out);
+        void reset() { granules = 0; }
+    };
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_FEATURES_H_
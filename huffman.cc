@@ -54,6 +54,19 @@ namespace mp3 {
         return curr->sample_values;
     }
 
+    HuffmanTree* huffmanTable(uint32_t table_num) {
+        // function-local statics are initialized exactly once, even with
+        // several threads racing to the first call
+        static HuffmanTree** tables = [] {
+            static HuffmanTree* trees[kNumHuffmanTables];
+            for (uint32_t i = 0; i < kNumHuffmanTables; i++) {
+                trees[i] = new HuffmanTree(i);
+            }
+            return trees;
+        }();
+        return tables[table_num];
+    }
+
     HuffmanTreeNode::HuffmanTreeNode() : is_leaf(false) {
         children = new HuffmanTreeNode*[2];
         children[0] = children[1] = nullptr; 
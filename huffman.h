@@ -32,6 +32,10 @@ namespace mp3 {
         int* getSampleValues(uint8_t* main_data, int* bit);
     };
 
+    // the tree for table table_num; the trees are built on first use and
+    // shared by every decoder (they are never modified afterwards)
+    HuffmanTree* huffmanTable(uint32_t table_num);
+
 }
 
 }
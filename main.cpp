@@ -1,6 +1,7 @@
 #include <iostream>
 #include <fstream>
 #include "mp3.h"
+#include "sync.h"
 
 using namespace std;
 
@@ -26,7 +27,11 @@ int main(){
     ifs.open ("../test.mp3", std::ifstream::in);
 
     uint8_t data [4096];
-    ifs.read((char*)data, 70);
+
+    // skip the ID3v2 tag, its size is stored in the tag header
+    io::audio::mp3::ID3 id3;
+    ifs.read((char*)&id3, sizeof(id3));
+    ifs.seekg(id3.isID3() ? id3.tagSize() : 0);
 
     /*auto mp3 = new io::audio::mp3::MP3(data);
     uint32_t num_frames = 0;
@@ -42,6 +47,19 @@ int main(){
         ifs.read((char*)data, 4);
         if (ifs.fail()) break;
         decoder->getHeader(data);
+        if (!decoder->header->isValid()) {
+            // garbage or a truncated frame: scan ahead for the next frame
+            std::streamoff pos = (std::streamoff)ifs.tellg() - 4;
+            ifs.seekg(pos);
+            ifs.read((char*)data, sizeof(data));
+            ifs.clear();
+            size_t offset;
+            auto result = io::audio::mp3::findFrame(data, ifs.gcount(), &offset,
+                io::audio::mp3::kDefaultChainLength, ifs.gcount() < (std::streamsize)sizeof(data));
+            if (result == io::audio::mp3::SyncResult::kNotFound && ifs.gcount() < 4) break;
+            ifs.seekg(pos + (std::streamoff)offset);
+            continue;
+        }
         ifs.read((char*)(data+4), decoder->header->frameLength()-4);
         std::cout << "frame " << num_frames << ", frame len " << decoder->header->frameLength() << '\n';
         uint32_t ret = decoder->readFrame(data);
@@ -20,6 +20,24 @@ namespace util {
 
         inline double abs(double n) { return (n > 0 ? n : -n); }
 
+        // for tables built at compile time: reduced to [-pi/2, pi/2] first,
+        // so the series is accurate to double precision at any angle
+        constexpr double sinConst(double n) {
+            n -= 2 * M_PI * (long long)(n / (2 * M_PI));
+            if (n > M_PI) n -= 2 * M_PI;
+            if (n < -M_PI) n += 2 * M_PI;
+            if (n > M_PI / 2) n = M_PI - n;
+            if (n < -M_PI / 2) n = -M_PI - n;
+            double term = n;
+            double sum = n;
+            for (int i = 1; i < 12; i++) {
+                term *= -n * n / ((2 * i) * (2 * i + 1));
+                sum += term;
+            }
+            return sum;
+        }
+        constexpr double cosConst(double n) { return sinConst(M_PI / 2 - n); }
+
     }  // namespace math
 
 }  // namespace util
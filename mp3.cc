@@ -1,5 +1,6 @@
 #include "mp3.h"
 #include "math.h"
+#include "sync.h"
 
 namespace io {
 
@@ -7,303 +8,472 @@ namespace audio {
 
 namespace mp3 {
     
+    DecoderScratch& DecoderScratch::get() {
+        thread_local DecoderScratch scratch;
+        return scratch;
+    }
+
     MP3FrameDecoder::MP3FrameDecoder() {
-        header = new MP3FrameHeader{};
-        side_info = new MP3SideInfo{};
-        for (uint32_t i = 0; i < kNumHuffmanTables; i++) {
-            tables[i] = new HuffmanTree(i);
-        }
+        header = &frame_header;
+        memset(&frame_header, 0, sizeof(frame_header));
+        memset(prev_samples, 0, sizeof(prev_samples));
+        memset(fifo, 0, sizeof(fifo));
+        reservoir_size = 0;
+        band_index.long_win = nullptr;
+        band_index.short_win = nullptr;
+        band_width.long_win = nullptr;
+        band_width.short_win = nullptr;
+        reorder_source = nullptr;
+        resampler = nullptr;
+        analyzer = nullptr;
+        waveform = nullptr;
+        out_samples = 0;
+        bindScratch();
     }
 
     MP3FrameDecoder::~MP3FrameDecoder() {
-        free(header);
-        free(side_info);
-        for (uint32_t i = 0; i < kNumHuffmanTables; i++) {
-            free(tables[i]);
-        }
+    }
+
+    void MP3FrameDecoder::bindScratch() {
+        DecoderScratch& scratch = DecoderScratch::get();
+        side_info = &scratch.side_info;
+        samples = scratch.samples;
+        scalefac_l = scratch.scalefac_l;
+        scalefac_s = scratch.scalefac_s;
+        main_data = scratch.main_data;
+        pcm = scratch.pcm;
     }
 
     void MP3FrameDecoder::postHeaderSetup() {
-        switch (header->getSamplingRate()) {
-            case 32000:
-                band_index.short_win = kBandIndexTable.short_32;
-                band_width.short_win = kBandWidthTable.short_32;
-                band_index.long_win = kBandIndexTable.long_32;
-                band_width.long_win = kBandWidthTable.long_32;
-                break;
-            case 44100:
-                band_index.short_win = kBandIndexTable.short_44;
-                band_width.short_win = kBandWidthTable.short_44;
-                band_index.long_win = kBandIndexTable.long_44;
-                band_width.long_win = kBandWidthTable.long_44;
-                break;
-            case 48000:
-                band_index.short_win = kBandIndexTable.short_48;
-                band_width.short_win = kBandWidthTable.short_48;
-                band_index.long_win = kBandIndexTable.long_48;
-                band_width.long_win = kBandWidthTable.long_48;
-                break;
-        }
-        for (int i = num_prev_frames-1; i > 0; i--) {
-            prev_frame_size[i] = prev_frame_size[i - 1];
-        }
-        prev_frame_size[0] = header->frameLength();
+        // unset for anything but MPEG-1 layer III, which setMainData refuses
+        const BandTables* bands = header->isDecodable() ? header->info().bands : nullptr;
+        band_index.long_win = bands ? bands->index_long : nullptr;
+        band_index.short_win = bands ? bands->index_short : nullptr;
+        band_width.long_win = bands ? bands->width_long : nullptr;
+        band_width.short_win = bands ? bands->width_short : nullptr;
+        reorder_source = bands ? bands->reorder : nullptr;
     }
 
     void MP3FrameDecoder::getHeader(uint8_t* data) {
-        // load the header data
-        for (int i = 0; i < 4; i++) {
-            ((uint8_t*)header)[i] = data[3-i];
-        }
+        *header = loadHeader(data);
         postHeaderSetup();
     }
 
     // data points to the start of the frame header
     uint32_t MP3FrameDecoder::readFrame(uint8_t* data) {
+        bindScratch();
+        uint32_t ret = decodeFrame(data, pcm);
+        if (ret == 0) return 0;
+
+        for (uint32_t j = 0; j < out_samples; j++) std::cout << pcm[j] << ((j+1)%20 ? ' ' : '\n');
+        if(out_samples%20) std::cout << '\n';
+        return ret;
+    }
+
+    // data points to the start of the frame header, out must hold
+    // maxFrameSamples() samples
+    uint32_t MP3FrameDecoder::decodeFrame(uint8_t* data, int16_t* out) {
+        bindScratch();
+
         // store start of frame
         uint8_t* frame_start = data;
         data += 4;
 
-        // if the frame sync is not all 1s, this is not an MP3 frame
-        if (header->frame_sync != 2047) return 0;
+        // if the frame sync is not all 1s, this is not an MP3 frame; other
+        // versions and layers are refused rather than misparsed
+        if (!header->isDecodable() || !band_index.long_win) return 0;
 
         // skip the CRC (if protection_bit is 0)
         if (!header->protection_bit) {
             data += 2;
         }
 
-        // process side info and main data
+        // process side info and main data; if the bit reservoir does not hold
+        // the data this frame refers to (e.g. the first frame after a seek), the
+        // frame can't be decoded and comes out silent
         setSideInfo(data);
-        setMainData(frame_start);
+        if (!setMainData(frame_start)) {
+            if (resampler || analyzer || waveform) {
+                // keep the resampler's, analyzer's and overview's timing: run silence through
+                memset(samples, 0, 2 * 2 * 576 * sizeof(float));
+            }
+            if (analyzer) {
+                analyzeGranule(0);
+                analyzeGranule(1);
+            }
+            if (waveform) {
+                waveformGranule(0);
+                waveformGranule(1);
+            }
+            if (resampler) {
+                resampleFrame(out);
+            } else {
+                memset(out, 0, 2304 * sizeof(int16_t));
+                out_samples = 2304;
+            }
+            if (analyzer) analyzer->addPCM(out, out_samples);
+            return header->frameLength();
+        }
 
         //header->printHeader();
         //side_info->printSideInfo();
 
         // produce samples
         for (int gr = 0; gr < 2; gr++) {
-            for (uint32_t ch = 0; ch < header->channels(); ch++) {
-                requantize(gr, ch);
+            transformGranule(gr);
+
+            // analyze and resample while the granule's synthesis output is
+            // still in cache
+            if (analyzer) analyzeGranule(gr);
+            if (waveform) waveformGranule(gr);
+            if (resampler) {
+                if (gr == 0) out_samples = 0;
+                resampleGranule(gr, out);
             }
+        }
+
+        if (!resampler) {
+            interleave(out);
+            out_samples = 2304;
+        }
+        if (analyzer) analyzer->addPCM(out, out_samples);
+
+        return header->frameLength();
+    }
 
-            if (header->channel_mode == 1 && (header->mode_extension >> 1)) {
-                midSideStereo(gr);
+    DecodeResult MP3FrameDecoder::decodeFrames(uint8_t* input, size_t input_size, int16_t* out,
+                                               size_t out_size, uint32_t max_frames) {
+        DecodeResult result = {};
+        while (result.frames < max_frames) {
+            size_t remaining = input_size - result.bytes_consumed;
+            if (remaining < 4 || out_size - result.samples < maxFrameSamples()) break;
+
+            uint8_t* frame = input + result.bytes_consumed;
+            MP3FrameHeader next = loadHeader(frame);
+            if (!next.isValid()) {
+                // skip garbage up to the next frame we trust
+                size_t offset;
+                SyncResult sync = findFrame(frame, remaining, &offset);
+                result.bytes_consumed += offset;
+                if (sync != SyncResult::kFound) break;
+                continue;
             }
 
-            for (uint32_t ch = 0; ch < header->channels(); ch++) {
-                if (side_info->block_type[gr][ch] == 2 || side_info->mixed_block_flag[gr][ch]) {
-                    reorder(gr, ch);
-                } else {
-                    aliasReduction(gr, ch);
-                }
-                IMDCT(gr, ch);
-                frequencyInversion(gr, ch);
-                synthFilterbank(gr, ch);
+            // wait for the rest of the frame
+            uint32_t frame_size = next.frameLength();
+            if (frame_size > remaining) break;
+            // a frame of another version or layer: step over it
+            if (!next.isDecodable()) {
+                result.bytes_consumed += frame_size;
+                continue;
             }
+
+            getHeader(frame);
+            decodeFrame(frame, out + result.samples);
+            result.bytes_consumed += frame_size;
+            result.samples += out_samples;
+            result.frames++;
         }
+        if (analyzer) result.analysis = analyzer->result();
+        return result;
+    }
+
+    uint32_t MP3FrameDecoder::extractFrameFeatures(uint8_t* data, FeatureExtractor& extractor, GranuleFeatures* out) {
+        bindScratch();
 
-        interleave();
+        uint8_t* frame_start = data;
+        data += 4;
+        if (!header->isDecodable() || !band_index.long_win) return 0;
+        if (!header->protection_bit) {
+            data += 2;
+        }
+
+        setSideInfo(data);
+        bool decoded = setMainData(frame_start);
+
+        float power[576];
+        for (int gr = 0; gr < 2; gr++) {
+            bool short_blocks = false;
+            if (!decoded) {
+                memset(power, 0, sizeof(power));
+            } else {
+                for (uint32_t ch = 0; ch < header->channels(); ch++) {
+                    requantize(gr, ch);
+                }
+                if (header->channel_mode == 1 && (header->mode_extension >> 1)) {
+                    midSideStereo(gr);
+                }
+                for (uint32_t ch = 0; ch < header->channels(); ch++) {
+                    if (side_info->granule[gr][ch].block_type == 2 || side_info->granule[gr][ch].mixed_block_flag) {
+                        reorder(gr, ch);
+                        short_blocks = true;
+                    }
+                }
+                spectralPower(gr, power);
+            }
+            extractor.extract(power, header->getSamplingRate(), band_index.long_win, short_blocks, &out[gr]);
+        }
 
         return header->frameLength();
     }
 
-    void MP3FrameDecoder::setMainData(uint8_t* buffer) {
-        int constant = 36+2*(header->protection_bit == 0);
-        // put the main data in a separate buffer so that side info and header
-        // do not interfere; main_data_begin may be larger than the previous frame
-        // and does not include the size of side info and headers
-        uint32_t frame_size = header->frameLength();
-        if (side_info->main_data_begin == 0) {
-            main_data_buffer.setSize(frame_size - constant);
-            memcpy(&main_data_buffer[0], buffer + constant, frame_size - constant);
-        } else {
-            int bound = 0;
-            for (int frame = 0; frame < num_prev_frames; frame++) {
-                bound += prev_frame_size[frame] - constant;
-                if ((int)side_info->main_data_begin < bound) {
-                    int ptr_offset = side_info->main_data_begin + frame * constant;
-                    int buffer_offset = 0;
-
-                    int part[num_prev_frames];
-                    part[frame] = side_info->main_data_begin;
-                    for (int i = 0; i <= frame-1; i++) {
-                        part[i] = prev_frame_size[i] - constant;
-                        part[frame] -= part[i];
+    // power per line, averaged over channels; a reordered short block
+    // granule holds 192 lines for each of 3 windows, each spread over the 3
+    // long lines it covers
+    void MP3FrameDecoder::spectralPower(uint32_t gr, float* power) {
+        memset(power, 0, 576 * sizeof(float));
+        uint32_t channels = header->channels();
+        float scale = 1.0f / channels;
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            const float* lines = samples[gr][ch];
+            if (side_info->granule[gr][ch].block_type == 2 || side_info->granule[gr][ch].mixed_block_flag) {
+                for (int sb = 0; sb < 32; sb++)
+                    for (int j = 0; j < 6; j++) {
+                        float e = 0;
+                        for (int w = 0; w < 3; w++) {
+                            float x = lines[sb * 18 + w * 6 + j];
+                            e += x * x;
+                        }
+                        int k = (sb * 6 + j) * 3;
+                        e *= scale / 3;
+                        power[k] += e;
+                        power[k + 1] += e;
+                        power[k + 2] += e;
                     }
+            } else {
+                for (int i = 0; i < 576; i++)
+                    power[i] += lines[i] * lines[i] * scale;
+            }
+        }
+    }
 
-                    main_data_buffer.setSize(frame_size - constant + side_info->main_data_begin);
-                    memcpy(main_data_buffer.data(), buffer - ptr_offset, part[frame]);
-                    ptr_offset -= (part[frame] + constant);
-                    buffer_offset += part[frame];
-                    for (int i = frame-1; i >= 0; i--) {
-                        memcpy(&main_data_buffer[buffer_offset], buffer - ptr_offset, part[i]);
-                        ptr_offset -= (part[i] + constant);
-                        buffer_offset += part[i];
-                    }
-                    memcpy(&main_data_buffer[side_info->main_data_begin], buffer + constant, frame_size - constant);
-                    break;
-                }
+    DecodeResult MP3FrameDecoder::extractFeatures(uint8_t* input, size_t input_size, FeatureExtractor& extractor,
+                                                  GranuleFeatures* out, size_t max_granules) {
+        DecodeResult result = {};
+        while (max_granules - result.samples >= 2) {
+            size_t remaining = input_size - result.bytes_consumed;
+            if (remaining < 4) break;
+
+            uint8_t* frame = input + result.bytes_consumed;
+            MP3FrameHeader next = loadHeader(frame);
+            if (!next.isValid()) {
+                size_t offset;
+                SyncResult sync = findFrame(frame, remaining, &offset);
+                result.bytes_consumed += offset;
+                if (sync != SyncResult::kFound) break;
+                continue;
             }
+
+            uint32_t frame_size = next.frameLength();
+            if (frame_size > remaining) break;
+            if (!next.isDecodable()) {
+                result.bytes_consumed += frame_size;
+                continue;
+            }
+
+            getHeader(frame);
+            extractFrameFeatures(frame, extractor, out + result.samples);
+            result.bytes_consumed += frame_size;
+            result.samples += 2;
+            result.frames++;
+        }
+        return result;
+    }
+
+    // fixed part of a snapshot, followed by reservoir_size bytes of main data
+    struct SnapshotState {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t reservoir_size;
+        uint8_t header[4];
+        float prev_samples[2][32][18];
+        float fifo[2][1024];
+    };
+
+    size_t MP3FrameDecoder::snapshotSize() {
+        return sizeof(SnapshotState) + reservoir_size;
+    }
+
+    size_t MP3FrameDecoder::snapshot(uint8_t* out, size_t size) {
+        size_t total = snapshotSize();
+        if (size < total) return 0;
+
+        SnapshotState* state = (SnapshotState*)out;
+        uint16_t reservoir_size = total - sizeof(SnapshotState);
+        state->magic = kSnapshotMagic;
+        state->version = kSnapshotVersion;
+        state->reservoir_size = reservoir_size;
+        memcpy(state->header, header, 4);
+        memcpy(state->prev_samples, prev_samples, sizeof(prev_samples));
+        memcpy(state->fifo, fifo, sizeof(fifo));
+        memcpy(out + sizeof(SnapshotState), reservoir, reservoir_size);
+        return total;
+    }
+
+    bool MP3FrameDecoder::restore(const uint8_t* in, size_t size) {
+        if (size < sizeof(SnapshotState)) return false;
+        SnapshotState state;
+        memcpy(&state, in, sizeof(SnapshotState));
+        if (state.magic != kSnapshotMagic || state.version != kSnapshotVersion
+            || state.reservoir_size > kMaxReservoirSize
+            || size < sizeof(SnapshotState) + state.reservoir_size) {
+            return false;
         }
 
+        memcpy(header, state.header, 4);
+        // picks the band tables for the sampling rate
+        postHeaderSetup();
+        memcpy(prev_samples, state.prev_samples, sizeof(prev_samples));
+        memcpy(fifo, state.fifo, sizeof(fifo));
+        reservoir_size = state.reservoir_size;
+        memcpy(reservoir, in + sizeof(SnapshotState), reservoir_size);
+        return true;
+    }
+
+    bool MP3FrameDecoder::setMainData(uint8_t* buffer) {
+        if (!band_index.long_win || !loadMainData(buffer)) return false;
+
         int bit = 0;
         for (int gr = 0; gr < 2; gr++)
             for (uint32_t ch = 0; ch < header->channels(); ch++) {
-                int max_bit = bit + side_info->part2_3_length[gr][ch];
-                unpackScalefacs(main_data_buffer.data(), gr, ch, bit);
-                unpackSamples(main_data_buffer.data(), gr, ch, bit, max_bit);
+                int max_bit = bit + side_info->granule[gr][ch].part2_3_length;
+                unpackScalefacs(main_data, gr, ch, bit);
+                unpackSamples(main_data, gr, ch, bit, max_bit);
                 bit = max_bit;
             }
+        return true;
     }
 
-    void MP3FrameDecoder::setSideInfo(uint8_t* buffer) {
-        int count = 0;
-
-        // number of bytes the main data ends before the next frame header
-        side_info->main_data_begin = (int)readBitsInc(buffer, &count, 9);
+    bool MP3FrameDecoder::loadMainData(uint8_t* buffer) {
+        // mono side info is 17 bytes, not 32
+        uint32_t main_data_size = header->mainDataSize();
+        uint32_t constant = header->frameLength() - main_data_size;
+        uint32_t main_data_begin = side_info->main_data_begin;
+
+        // main_data_begin counts back into the main data of previous frames
+        // (side info and headers excluded), the tail of which is kept in
+        // reservoir; put those bytes in front of this frame's main data
+        bool available = main_data_begin <= reservoir_size;
+        if (available) {
+            memcpy(main_data, reservoir + reservoir_size - main_data_begin, main_data_begin);
+        } else {
+            main_data_begin = 0;
+        }
+        memcpy(main_data + main_data_begin, buffer + constant, main_data_size);
 
-        // skip private bits
-        count += 3; 
+        // keep the tail for the next frame
+        uint32_t total = main_data_begin + main_data_size;
+        reservoir_size = min(total, kMaxReservoirSize);
+        memcpy(reservoir, main_data + total - reservoir_size, reservoir_size);
+        return available;
+    }
 
-        for (uint32_t ch = 0; ch < header->channels(); ch++)
-            for (int scfsi_band = 0; scfsi_band < 4; scfsi_band++)
-                // scale factor selection information.
-                // if scfsi[scfsi_band] == 1, then scale factors for the first granule are reused in the second granule
-                // if scfsi[scfsi_band] == 0, then each granule has its own scaling factors
-                side_info->scfsi[ch][scfsi_band] = readBitsInc(buffer, &count, 1) != 0;
+    // the 64 bits from bit start on, out of side info held big endian in words
+    static inline uint64_t sideInfoBits(const uint64_t* words, int start) {
+        int word = start >> 6;
+        int shift = start & 63;
+        return shift ? words[word] << shift | words[word + 1] >> (64 - shift) : words[word];
+    }
 
-        for (int gr = 0; gr < 2; gr++)
-            for (uint32_t ch = 0; ch < header->channels(); ch++) {
-                // length of the scaling factors and main data in bits
-                side_info->part2_3_length[gr][ch] = (int)readBitsInc(buffer, &count, 12);
-                // number of values in each big_region
-                side_info->big_value[gr][ch] = (int)readBitsInc(buffer, &count, 9);
-                // quantizer step size
-                side_info->global_gain[gr][ch] = (int)readBitsInc(buffer, &count, 8);
-                // used to determine the values of slen1 and slen2
-                side_info->scalefac_compress[gr][ch] = (int)readBitsInc(buffer, &count, 4);
-                // number of bits given to a range of scale factors.
-                side_info->slen1[gr][ch] = kSlenTable[side_info->scalefac_compress[gr][ch]][0];
-                side_info->slen2[gr][ch] = kSlenTable[side_info->scalefac_compress[gr][ch]][1];
-                // if set, a not normal window is used
-                side_info->window_switching[gr][ch] = readBitsInc(buffer, &count, 1) == 1;
-
-                if (side_info->window_switching[gr][ch]) {
-                    // the window type for the granule, 2 is special
-                    side_info->block_type[gr][ch] = (int)readBitsInc(buffer, &count, 2);
-                    // number of scale factor bands before window switching
-                    side_info->mixed_block_flag[gr][ch] = readBitsInc(buffer, &count, 1) == 1;
-                    if (side_info->mixed_block_flag[gr][ch]) {
-                        side_info->switch_point_l[gr][ch] = 8;
-                        side_info->switch_point_s[gr][ch] = 3;
-                    } else {
-                        side_info->switch_point_l[gr][ch] = 0;
-                        side_info->switch_point_s[gr][ch] = 0;
-                    }
+    // bits holds one granule's 59 bits from the top down
+    static inline void parseGranule(uint64_t bits, GranuleSideInfo* granule) {
+        granule->part2_3_length = bits >> 52;
+        granule->big_value = bits >> 43 & 0x1FF;
+        granule->global_gain = bits >> 35 & 0xFF;
+        granule->scalefac_compress = bits >> 31 & 0xF;
+        bool window_switching = bits >> 30 & 1;
+        granule->window_switching = window_switching;
+
+        // the next 22 bits are either block type, mixed flag, two table
+        // selects and the subblock gains, or three table selects and the
+        // region counts; both are decoded and the right one kept
+        uint32_t block_type = window_switching ? bits >> 28 & 3 : 0;
+        granule->block_type = block_type;
+        granule->mixed_block_flag = window_switching && (bits >> 27 & 1);
+        granule->table_select[0] = window_switching ? bits >> 22 & 31 : bits >> 25 & 31;
+        granule->table_select[1] = window_switching ? bits >> 17 & 31 : bits >> 20 & 31;
+        granule->table_select[2] = window_switching ? 0 : bits >> 15 & 31;
+        for (int window = 0; window < 3; window++) {
+            granule->subblock_gain[window] = window_switching ? bits >> (14 - 3 * window) & 7 : 0;
+        }
+        // with window switching the regions are fixed, and there is no third
+        uint32_t region0 = window_switching ? (block_type == 2 ? 8 : 7) : bits >> 11 & 15;
+        granule->region0_count = region0;
+        granule->region1_count = window_switching ? 20 - region0 : bits >> 8 & 7;
+
+        granule->preflag = bits >> 7 & 1;
+        granule->scalefac_scale = bits >> 6 & 1;
+        granule->count1table_select = bits >> 5 & 1;
+    }
 
-                    // these are set by default if window_switching
-                    side_info->region0_count[gr][ch] = side_info->block_type[gr][ch] == 2 ? 8 : 7;
-                    // no third region
-                    side_info->region1_count[gr][ch] = 20 - side_info->region0_count[gr][ch];
-
-                    for (int region = 0; region < 2; region++)
-                        // huffman table number for a big region
-                        side_info->table_select[gr][ch][region] = (int)readBitsInc(buffer, &count, 5);
-                    for (int window = 0; window < 3; window++)
-                        side_info->subblock_gain[gr][ch][window] = (int)readBitsInc(buffer, &count, 3);
-                } else {
-                    // set by default if !window_switching
-                    side_info->block_type[gr][ch] = 0;
-                    side_info->mixed_block_flag[gr][ch] = false;
-
-                    for (int region = 0; region < 3; region++)
-                        side_info->table_select[gr][ch][region] = (int)readBitsInc(buffer, &count, 5);
-
-                    // number of scale factor bands in the first big value region
-                    side_info->region0_count[gr][ch] = (int)readBitsInc(buffer, &count, 4);
-                    // number of scale factor bands in the third big value region
-                    side_info->region1_count[gr][ch] = (int)readBitsInc(buffer, &count, 3);
-                }
+    // the 17 (mono) or 32 byte side info, loaded as big endian words so
+    // every field is a constant shift and mask
+    template <uint32_t kChannels>
+    static void parseSideInfo(const uint8_t* buffer, MP3SideInfo* side_info) {
+        // one word of slack, so a granule never runs past the last word
+        uint64_t words[kChannels == 1 ? 3 : 5];
+        for (uint32_t i = 0; i < sizeof(words) / 8; i++) {
+            memcpy(&words[i], buffer + 8 * i, 8);
+            words[i] = __builtin_bswap64(words[i]);
+        }
 
-                // if set, add values from a table to the scaling factors
-                side_info->preflag[gr][ch] = (int)readBitsInc(buffer, &count, 1);
-                // determines the step size
-                side_info->scalefac_scale[gr][ch] = (int)readBitsInc(buffer, &count, 1);
-                // table that determines which count1 table is used
-                side_info->count1table_select[gr][ch] = (int)readBitsInc(buffer, &count, 1);
-            }
+        side_info->main_data_begin = words[0] >> 55;
+        // private bits (5 mono, 3 stereo), then 4 scfsi bits per channel
+        const int scfsi_start = kChannels == 1 ? 14 : 12;
+        for (uint32_t ch = 0; ch < kChannels; ch++)
+            for (int band = 0; band < 4; band++)
+                side_info->scfsi[ch][band] = words[0] >> (63 - scfsi_start - 4 * ch - band) & 1;
+
+        const int granule_start = scfsi_start + 4 * kChannels;
+        for (uint32_t gr = 0; gr < 2; gr++)
+            for (uint32_t ch = 0; ch < kChannels; ch++)
+                parseGranule(sideInfoBits(words, granule_start + 59 * (gr * kChannels + ch)),
+                             &side_info->granule[gr][ch]);
+
+        if (kChannels == 1) {
+            memset(side_info->scfsi[1], 0, sizeof(side_info->scfsi[1]));
+            side_info->granule[0][1] = GranuleSideInfo();
+            side_info->granule[1][1] = GranuleSideInfo();
+        }
+    }
 
+    // reads up to 40 bytes from buffer, which is always inside the frame
+    void MP3FrameDecoder::setSideInfo(uint8_t* buffer) {
+        if (header->channel_mode == 3) {
+            parseSideInfo<1>(buffer, side_info);
+        } else {
+            parseSideInfo<2>(buffer, side_info);
+        }
     }
 
     void MP3FrameDecoder::unpackScalefacs(uint8_t* main_data, uint32_t granule, uint32_t channel, int &bit) {
-        auto slen = kSlenTable[side_info->scalefac_compress[granule][channel]];
-        if (side_info->block_type[granule][channel] == 2 && side_info->window_switching[granule][channel]) {
-            if (side_info->mixed_block_flag[granule][channel]) {
-                for (int i = 0; i < 8; i++) {
-                    scalefac_l[granule][channel][i] = (int)readBitsInc(main_data, &bit, slen[0]);
-                }
+        ScalefacBlock block = kScalefacLong;
+        if (side_info->granule[granule][channel].block_type == 2 && side_info->granule[granule][channel].window_switching) {
+            block = side_info->granule[granule][channel].mixed_block_flag ? kScalefacMixed : kScalefacShort;
+        }
+        const ScalefacLayout& layout = kScalefacLayouts.layout[block][side_info->granule[granule][channel].scalefac_compress];
+        const bool* scfsi = side_info->scfsi[channel];
 
-                for (int j = 3; j < 6; j++) {
-                    for (int i = 0; i < 3; i++) {
-                        scalefac_s[granule][channel][i][j] = (int)readBitsInc(main_data, &bit, slen[0]);
-                    }
-                }
-            } else {
-                for (int j = 0; j < 6; j++) {
-                    for (int i = 0; i < 3; i++) {
-                        scalefac_s[granule][channel][i][j] = (int)readBitsInc(main_data, &bit, slen[0]);
-                    }
-                }
-            }
+        for (int g = 0; g < layout.num_groups; g++) {
+            const ScalefacGroup& group = layout.groups[g];
+            int* out = (group.is_short ? scalefac_s[granule][channel][0] : scalefac_l[granule][channel]) + group.first;
 
-            for (int j = 6; j < 12; j++) {
-                for (int i = 0; i < 3; i++) {
-                    scalefac_s[granule][channel][i][j] = (int)readBitsInc(main_data, &bit, slen[1]);
-                }
+            // granule 1 reuses granule 0's scalefactors for the scfsi bands set
+            if (granule == 1 && group.scfsi < 4 && scfsi[group.scfsi]) {
+                memcpy(out, scalefac_l[0][channel] + group.first, group.count * sizeof(int));
+                continue;
             }
-
-            for (int i = 0; i < 3; i++) {
-                scalefac_s[granule][channel][i][12] = 0;
+            if (group.bits == 0) {
+                memset(out, 0, group.count * sizeof(int));
+                continue;
             }
-        } else {
-            if (granule == 0) {
-                for (int i = 0; i < 21; i++) {
-                    if (i < 11) {
-                        scalefac_l[granule][channel][i] = readBitsInc(main_data, &bit, slen[0]);
-                    } else {
-                        scalefac_l[granule][channel][i] = readBitsInc(main_data, &bit, slen[1]);
-                    }
-                }
-            } else {
-                auto scfsi = side_info->scfsi[channel];
-                for (int i = 0; i < 21; i++) {
-                    if (i < 6) {
-                        if (scfsi[0]) {
-                            scalefac_l[granule][channel][i] = scalefac_l[0][channel][i];
-                        } else {
-                            scalefac_l[granule][channel][i] = readBitsInc(main_data, &bit, slen[0]);
-                        }
-                    } else if (i < 11) {
-                        if (scfsi[1]) {
-                            scalefac_l[granule][channel][i] = scalefac_l[0][channel][i];
-                        } else {
-                            scalefac_l[granule][channel][i] = readBitsInc(main_data, &bit, slen[0]);
-                        }
-                    } else if (i < 16) {
-                        if (scfsi[2]) {
-                            scalefac_l[granule][channel][i] = scalefac_l[0][channel][i];
-                        } else {
-                            scalefac_l[granule][channel][i] = readBitsInc(main_data, &bit, slen[1]);
-                        }
-                    } else {
-                        if (scfsi[3]) {
-                            scalefac_l[granule][channel][i] = scalefac_l[0][channel][i];
-                        } else {
-                            scalefac_l[granule][channel][i] = readBitsInc(main_data, &bit, slen[1]);
-                        }
-                    }
-                }
-                scalefac_l[granule][channel][21] = 0;
+
+            uint64_t window = peekWindow(main_data, bit);
+            for (int i = 0; i < group.count; i++) {
+                out[i] = (int)(window >> (64 - group.bits));
+                window <<= group.bits;
             }
+            bit += group.count * group.bits;
         }
     }
 
@@ -319,25 +489,25 @@ namespace mp3 {
         // get the big value region boundaries
         int region0;
         int region1;
-        if (side_info->window_switching[gr][ch] && side_info->block_type[gr][ch] == 2) {
+        if (side_info->granule[gr][ch].window_switching && side_info->granule[gr][ch].block_type == 2) {
             region0 = 36;
             region1 = 576;
         } else {
-            region0 = band_index.long_win[side_info->region0_count[gr][ch] + 1];
-            region1 = band_index.long_win[side_info->region0_count[gr][ch] + 1 + side_info->region1_count[gr][ch] + 1];
+            region0 = band_index.long_win[side_info->granule[gr][ch].region0_count + 1];
+            region1 = band_index.long_win[side_info->granule[gr][ch].region0_count + 1 + side_info->granule[gr][ch].region1_count + 1];
         }
 
         // get the samples in the big value region
         // IMPORTANT: each entry in the Huffman table yields two samples
-        for (; sample < (int)side_info->big_value[gr][ch] * 2; sample += 2) {
+        for (; sample < (int)side_info->granule[gr][ch].big_value * 2; sample += 2) {
             if (sample < region0) {
-                table_num = side_info->table_select[gr][ch][0];
+                table_num = side_info->granule[gr][ch].table_select[0];
             } else if (sample < region1) {
-                table_num = side_info->table_select[gr][ch][1];
+                table_num = side_info->granule[gr][ch].table_select[1];
             } else {
-                table_num = side_info->table_select[gr][ch][2];
+                table_num = side_info->granule[gr][ch].table_select[2];
             }
-            table = tables[table_num];
+            table = huffmanTable(table_num);
 
             if (table_num == 0) {
                 samples[gr][ch][sample] = 0;
@@ -363,42 +533,33 @@ namespace mp3 {
 
         }
 
-        // quadruples region
+        // quadruples region: a single peek covers the longest code (6 bits)
+        // and the sign bits that follow, one per nonzero value
+        const bool table_b = side_info->granule[gr][ch].count1table_select == 1;
         for (; bit < max_bit && sample + 4 < 576; sample += 4) {
-            int values[4];
-
-            // flip bits
-            if (side_info->count1table_select[gr][ch] == 1) {
-                unsigned bit_sample = readBitsInc(main_data, &bit, 4);
-                values[0] = (bit_sample & 0x08) > 0 ? 0 : 1;
-                values[1] = (bit_sample & 0x04) > 0 ? 0 : 1;
-                values[2] = (bit_sample & 0x02) > 0 ? 0 : 1;
-                values[3] = (bit_sample & 0x01) > 0 ? 0 : 1;
+            uint32_t peek = peekBits(main_data, bit, 10);
+            uint32_t quad, length;
+            if (table_b) {
+                // table B codes every quad in 4 bits, inverted
+                quad = ~peek >> 6 & 0xF;
+                length = 4;
             } else {
-                unsigned bit_sample = readBits(main_data, bit, bit + 32);
-                for (int entry = 0; entry < 16; entry++) {
-                    unsigned value = kQuadTable.hcod[entry];
-                    unsigned size = kQuadTable.hlen[entry];
-
-                    if (value >> (32 - size) == bit_sample >> (32 - size)) {
-                        bit += size;
-                        for (int i = 0; i < 4; i++)
-                            values[i] = (int)kQuadTable.value[entry][i];
-                        break;
-                    }
-                }
-            }
-
-            // get the sign bit
-            for (int i = 0; i < 4; i++) {
-                if (values[i] > 0 && readBitsInc(main_data, &bit, 1) == 1) {
-                    values[i] = -values[i];
-                }
+                uint8_t entry = kQuadLookup.entry[peek >> 4];
+                quad = entry & 0xF;
+                length = entry >> 4;
             }
 
+            // signs starts at the bit after the code and moves on only past
+            // nonzero values
+            uint32_t signs = peek << (22 + length);
+            float* out = &samples[gr][ch][sample];
             for (int i = 0; i < 4; i++) {
-                samples[gr][ch][sample + i] = values[i];
+                uint32_t value = quad >> (3 - i) & 1;
+                uint32_t negative = signs >> 31 & value;
+                signs <<= value;
+                out[i] = (float)((int)value - 2 * (int)negative);
             }
+            bit += length + __builtin_popcount(quad);
         }
 
         // fill remaining samples with zero
@@ -408,15 +569,43 @@ namespace mp3 {
 
     }
 
+    void MP3FrameDecoder::transformGranule(uint32_t gr) {
+        float lines[576];
+        requantizeGranule(gr);
+        for (uint32_t ch = 0; ch < header->channels(); ch++) {
+            transformSubbands(gr, ch, lines);
+            synthFilterbank(lines, ch, samples[gr][ch]);
+        }
+    }
+
+    void MP3FrameDecoder::requantizeGranule(uint32_t gr) {
+        requantizeChannel(gr, 0, false);
+        requantizeChannel(gr, 1, header->channel_mode == 1 && (header->mode_extension >> 1));
+    }
+
     void MP3FrameDecoder::requantize(uint32_t gr, uint32_t ch) {
+        requantizeChannel(gr, ch, false);
+    }
+
+    // with mid_side, channel 1 is requantized last and each line pair is
+    // turned from mid/side into left/right as soon as both are known
+    void MP3FrameDecoder::requantizeChannel(uint32_t gr, uint32_t ch, bool mid_side) {
         using namespace util;
-        float exp1, exp2;
+        const GranuleSideInfo& granule = side_info->granule[gr][ch];
+        float* lines = samples[gr][ch];
+        float* mid = samples[gr][0];
         int window = 0;
         int sfb = 0;
-        const float scalefac_mult = side_info->scalefac_scale[gr][ch] == 0 ? 0.5 : 1;
+        const float scalefac_mult = granule.scalefac_scale == 0 ? 0.5 : 1;
+
+        // the gain only changes between bands (and windows), so b and c
+        // are recomputed when (sfb, window) does
+        int gain_key = -1;
+        float b = 0, c = 0;
 
         for (uint32_t sample = 0, i = 0; sample < 576; sample++, i++) {
-            if (side_info->block_type[gr][ch] == 2 || (side_info->mixed_block_flag[gr][ch] && sfb >= 8)) {
+            float exp1, exp2;
+            if (granule.block_type == 2 || (granule.mixed_block_flag && sfb >= 8)) {
                 if (i == band_width.short_win[sfb]) {
                     i = 0;
                     if (window == 2) {
@@ -426,23 +615,42 @@ namespace mp3 {
                         window++;
                 }
 
-                exp1 = side_info->global_gain[gr][ch] - 210.0 - 8.0 * side_info->subblock_gain[gr][ch][window];
-                exp2 = scalefac_mult * scalefac_s[gr][ch][window][sfb];
+                if (gain_key != sfb * 4 + window + 1) {
+                    gain_key = sfb * 4 + window + 1;
+                    exp1 = granule.global_gain - 210.0 - 8.0 * granule.subblock_gain[window];
+                    exp2 = scalefac_mult * scalefac_s[gr][ch][sfb][window];
+                    b = math::power(2.0, exp1 / 4.0);
+                    c = math::power(2.0, -exp2);
+                }
             } else {
                 if (sample == band_index.long_win[sfb + 1])
                     /* Don't increment sfb at the zeroth sample. */
                     sfb++;
 
-                exp1 = side_info->global_gain[gr][ch] - 210.0;
-                exp2 = scalefac_mult * (scalefac_l[gr][ch][sfb] + side_info->preflag[gr][ch] * kPretab[sfb]);
+                if (gain_key != sfb * 4) {
+                    gain_key = sfb * 4;
+                    exp1 = granule.global_gain - 210.0;
+                    exp2 = scalefac_mult * (scalefac_l[gr][ch][sfb] + granule.preflag * kPretab[sfb]);
+                    b = math::power(2.0, exp1 / 4.0);
+                    c = math::power(2.0, -exp2);
+                }
             }
 
-            float sign = samples[gr][ch][sample] < 0 ? -1.0f : 1.0f;
-            float a = math::power(math::abs(samples[gr][ch][sample]), 4.0 / 3.0);
-            float b = math::power(2.0, exp1 / 4.0);
-            float c = math::power(2.0, -exp2);
+            float x = lines[sample];
+            float value = 0;
+            if (x != 0) {
+                float sign = x < 0 ? -1.0f : 1.0f;
+                float a = math::power(math::abs(x), 4.0 / 3.0);
+                value = sign * a * b * c;
+            }
 
-            samples[gr][ch][sample] = sign * a * b * c;
+            if (mid_side) {
+                float middle = mid[sample];
+                mid[sample] = (middle + value) / math::M_SQRT2;
+                lines[sample] = (middle - value) / math::M_SQRT2;
+            } else {
+                lines[sample] = value;
+            }
         }
     }
 
@@ -484,7 +692,7 @@ namespace mp3 {
     }
 
     void MP3FrameDecoder::aliasReduction(uint32_t granule, uint32_t channel) {
-        int sb_max = side_info->mixed_block_flag[granule][channel] ? 2 : 32;
+        int sb_max = side_info->granule[granule][channel].mixed_block_flag ? 2 : 32;
         for (int sb = 1; sb < sb_max; sb++)
             for (int sample = 0; sample < 8; sample++) {
                 int offset1 = 18 * sb - sample - 1;
@@ -502,99 +710,119 @@ namespace mp3 {
                 samples[granule][channel][i * 18 + sb] *= -1;
     }
 
-    void MP3FrameDecoder::IMDCT(uint32_t gr, uint32_t ch) {
-        static bool init = true;
-        static float sine_block[4][36];
+    // IMDCT, windowing and overlap of one subband's 18 lines; in and out
+    // may be the same
+    static inline void imdctSubband(const float* in, uint32_t block_type, float* prev, float* out) {
         float sample_block[36];
 
-        if (init) {
-            int i;
-            for (i = 0; i < 36; i++)
-                sine_block[0][i] = util::math::sin(util::math::M_PI / 36.0 * (i + 0.5));
-            for (i = 0; i < 18; i++)
-                sine_block[1][i] = util::math::sin(util::math::M_PI / 36.0 * (i + 0.5));
-            for (; i < 24; i++)
-                sine_block[1][i] = 1.0;
-            for (; i < 30; i++)
-                sine_block[1][i] = util::math::sin(util::math::M_PI / 12.0 * (i - 18.0 + 0.5));
-            for (; i < 36; i++)
-                sine_block[1][i] = 0.0;
-            for (i = 0; i < 12; i++)
-                sine_block[2][i] = util::math::sin(util::math::M_PI / 12.0 * (i + 0.5));
-            for (i = 0; i < 6; i++)
-                sine_block[3][i] = 0.0;
+        const int n = block_type == 2 ? 12 : 36;
+        const int half_n = n / 2;
+
+        for (int win = 0; win < (block_type == 2 ? 3 : 1); win++) {
+            for (int i = 0; i < n; i++) {
+                const float* cos = n == 36 ? kIMDCTTables.long_cos[i] : kIMDCTTables.short_cos[i];
+                float xi = 0.0;
+                for (int k = 0; k < half_n; k++) {
+                    xi += in[half_n * win + k] * cos[k];
+                }
+
+                /* Windowing samples. */
+                sample_block[win * n + i] = xi * kIMDCTTables.window[block_type][i];
+            }
+        }
+
+        if (block_type == 2) {
+            float temp_block[36];
+            memcpy(temp_block, sample_block, 36 * 4);
+
+            int i = 0;
+            for (; i < 6; i++)
+                sample_block[i] = 0;
             for (; i < 12; i++)
-                sine_block[3][i] = util::math::sin(util::math::M_PI / 12.0 * (i - 6.0 + 0.5));
+                sample_block[i] = temp_block[0 + i - 6];
             for (; i < 18; i++)
-                sine_block[3][i] = 1.0;
+                sample_block[i] = temp_block[0 + i - 6] + temp_block[12 + i - 12];
+            for (; i < 24; i++)
+                sample_block[i] = temp_block[12 + i - 12] + temp_block[24 + i - 18];
+            for (; i < 30; i++)
+                sample_block[i] = temp_block[24 + i - 18];
             for (; i < 36; i++)
-                sine_block[3][i] = util::math::sin(util::math::M_PI / 36.0 * (i + 0.5));
-            init = false;
+                sample_block[i] = 0;
         }
 
-        const int n = side_info->block_type[gr][ch] == 2 ? 12 : 36;
-        const int half_n = n / 2;
-        int sample = 0;
+        /* Overlap. */
+        for (int i = 0; i < 18; i++) {
+            out[i] = sample_block[i] + prev[i];
+            prev[i] = sample_block[18 + i];
+        }
+    }
 
+    void MP3FrameDecoder::IMDCT(uint32_t gr, uint32_t ch) {
         for (int block = 0; block < 32; block++) {
-            for (int win = 0; win < (side_info->block_type[gr][ch] == 2 ? 3 : 1); win++) {
-                for (int i = 0; i < n; i++) {
-                    float xi = 0.0;
-                    for (int k = 0; k < half_n; k++) {
-                        float s = samples[gr][ch][18 * block + half_n * win + k];
-                        xi += s * util::math::cos(util::math::M_PI / (2 * n) * (2 * i + 1 + half_n) * (2 * k + 1));
-                    }
+            float* lines = &samples[gr][ch][18 * block];
+            imdctSubband(lines, side_info->granule[gr][ch].block_type, prev_samples[ch][block], lines);
+        }
+    }
 
-                    /* Windowing samples. */
-                    sample_block[win * n + i] = xi * sine_block[side_info->block_type[gr][ch]][i];
-                }
+    // reorder or alias reduction, IMDCT and frequency inversion, one subband
+    // at a time: each subband is loaded once (gathered in subband order for
+    // short blocks), its alias butterflies with the next subband applied,
+    // and its 18 output samples written to out
+    void MP3FrameDecoder::transformSubbands(uint32_t gr, uint32_t ch, float* out) {
+        const GranuleSideInfo& granule = side_info->granule[gr][ch];
+        const float* lines = samples[gr][ch];
+        const bool reordered = granule.block_type == 2 || granule.mixed_block_flag;
+
+        float buffers[2][18];
+        float* cur = buffers[0];
+        float* next = buffers[1];
+        auto load = [&](int sb, float* to) {
+            if (reordered) {
+                const uint16_t* source = reorder_source + 18 * sb;
+                for (int i = 0; i < 18; i++) to[i] = source[i] < 576 ? lines[source[i]] : 0.0f;
+            } else {
+                memcpy(to, lines + 18 * sb, 18 * sizeof(float));
             }
-
-            if (side_info->block_type[gr][ch] == 2) {
-                float temp_block[36];
-                memcpy(temp_block, sample_block, 36 * 4);
-
-                int i = 0;
-                for (; i < 6; i++)
-                    sample_block[i] = 0;
-                for (; i < 12; i++)
-                    sample_block[i] = temp_block[0 + i - 6];
-                for (; i < 18; i++)
-                    sample_block[i] = temp_block[0 + i - 6] + temp_block[12 + i - 12];
-                for (; i < 24; i++)
-                    sample_block[i] = temp_block[12 + i - 12] + temp_block[24 + i - 18];
-                for (; i < 30; i++)
-                    sample_block[i] = temp_block[24 + i - 18];
-                for (; i < 36; i++)
-                    sample_block[i] = 0;
+        };
+
+        load(0, cur);
+        for (int sb = 0; sb < 32; sb++) {
+            if (sb < 31) {
+                load(sb + 1, next);
+                if (!reordered) {
+                    for (int sample = 0; sample < 8; sample++) {
+                        float s1 = cur[17 - sample];
+                        float s2 = next[sample];
+                        cur[17 - sample] = s1 * kCS[sample] - s2 * kCA[sample];
+                        next[sample] = s2 * kCS[sample] + s1 * kCA[sample];
+                    }
+                }
             }
 
-            /* Overlap. */
-            for (int i = 0; i < 18; i++) {
-                samples[gr][ch][sample + i] = sample_block[i] + prev_samples[ch][block][i];
-                prev_samples[ch][block][i] = sample_block[18 + i];
+            float* time = out + 18 * sb;
+            imdctSubband(cur, granule.block_type, prev_samples[ch][sb], time);
+            if (sb & 1) {
+                for (int i = 1; i < 18; i += 2) time[i] *= -1;
             }
-            sample += 18;
+            float* done = cur;
+            cur = next;
+            next = done;
         }
     }
 
     void MP3FrameDecoder::synthFilterbank(uint32_t gr, uint32_t ch) {
-        static float n[64][32];
-        static bool init = true;
-
-        if (init) {
-            init = false;
-            for (int i = 0; i < 64; i++)
-                for (int j = 0; j < 32; j++)
-                    n[i][j] = util::math::cos((16.0 + i) * (2.0 * j + 1.0) * (util::math::M_PI / 64.0));
-        }
+        float pcm[576];
+        synthFilterbank(samples[gr][ch], ch, pcm);
+        memcpy(samples[gr][ch], pcm, 576 * 4);
+    }
 
+    // lines holds 18 samples per subband; out may not alias it
+    void MP3FrameDecoder::synthFilterbank(const float* lines, uint32_t ch, float* out) {
         float s[32], u[512], w[512];
-        float pcm[576];
 
         for (int sb = 0; sb < 18; sb++) {
             for (int i = 0; i < 32; i++)
-                s[i] = samples[gr][ch][i * 18 + sb];
+                s[i] = lines[i * 18 + sb];
 
             for (int i = 1023; i > 63; i--)
                 fifo[ch][i] = fifo[ch][i - 64];
@@ -602,7 +830,7 @@ namespace mp3 {
             for (int i = 0; i < 64; i++) {
                 fifo[ch][i] = 0.0;
                 for (int j = 0; j < 32; j++)
-                    fifo[ch][i] += s[j] * n[i][j];
+                    fifo[ch][i] += s[j] * kSynthTables.cos[i][j];
             }
 
             for (int i = 0; i < 8; i++)
@@ -618,11 +846,9 @@ namespace mp3 {
                 float sum = 0;
                 for (int j = 0; j < 16; j++)
                     sum += w[j * 32 + i];
-                pcm[32 * sb + i] = sum;
+                out[32 * sb + i] = sum;
             }
         }
-
-        memcpy(samples[gr][ch], pcm, 576 * 4);
     }
 
     int16_t scalePCM(float sample) {
@@ -633,16 +859,37 @@ namespace mp3 {
         return (int16_t) f;
     }
 
-    void MP3FrameDecoder::interleave() {
+    void MP3FrameDecoder::resampleGranule(uint32_t gr, int16_t* out) {
+        const float* in[2] = {samples[gr][0], samples[gr][1]};
+        uint32_t channels = header->channels();
+        out_samples += resampler->process(in, channels, 576, out + out_samples) * channels;
+    }
+
+    void MP3FrameDecoder::analyzeGranule(uint32_t gr) {
+        const float* in[2] = {samples[gr][0], samples[gr][1]};
+        analyzer->addSamples(in, header->channels(), 576, header->getSamplingRate());
+    }
+
+    void MP3FrameDecoder::waveformGranule(uint32_t gr) {
+        const float* in[2] = {samples[gr][0], samples[gr][1]};
+        waveform->addSamples(in, header->channels(), 576, header->getSamplingRate());
+    }
+
+    void MP3FrameDecoder::resampleFrame(int16_t* out) {
+        out_samples = 0;
+        for (uint32_t gr = 0; gr < 2; gr++) {
+            resampleGranule(gr, out);
+        }
+    }
+
+    void MP3FrameDecoder::interleave(int16_t* out) {
         int i = 0;
         for (int gr = 0; gr < 2; gr++)
             for (int sample = 0; sample < 576; sample++)
                 for (uint32_t ch = 0; ch < header->channels(); ch++) {
-                    pcm[i] = scalePCM(samples[gr][ch][sample]);
+                    out[i] = scalePCM(samples[gr][ch][sample]);
                     i++;
                 }
-        for (int j = 0; j < i; j++) std::cout << pcm[j] << ((j+1)%20 ? ' ' : '\n');
-        if(i%20) std::cout << '\n';
     }
 
     void MP3SideInfo::printSideInfo() {
@@ -650,7 +897,7 @@ namespace mp3 {
         printf("\tmain_data_begin: %d\n", main_data_begin);
         printf("\tscsfi: ");
         for (int i = 0; i < 2; i++) {
-            for (int j = 0; j < 2; j++) {
+            for (int j = 0; j < 4; j++) {
                 printf("%d ", scfsi[i][j]);
             }
         }
@@ -659,32 +906,28 @@ namespace mp3 {
         for (int i = 0; i < 2; i++) {
             printf("************ GRANULE %d ***********\n", i + 1);
             for (int j = 0; j < 2; j++) {
+                const GranuleSideInfo& g = granule[i][j];
                 printf("************ CHANNEL %d ***********\n", j + 1);
-                printf("\tpart2_3_length: %d\n", part2_3_length[i][j]);
-                printf("\tpart2_length: %d\n", part2_length[i][j]);
-                printf("\tbig_value: %d\n", big_value[i][j]);
-                printf("\tglobal_gain: %d\n", global_gain[i][j]);
-                printf("\tscalefac_compress: %d\n", scalefac_compress[i][j]);
-                printf("\tslen1: %d\n", slen1[i][j]);
-                printf("\tslen2: %d\n", slen2[i][j]);
-                printf("\twindow_switching: %d\n", window_switching[i][j]);
-                printf("\tblock_type: %d\n", block_type[i][j]);
-                printf("\tmixed_block_flag: %d\n", mixed_block_flag[i][j]);
-                printf("\tswitch_point_l: %d\n", switch_point_l[i][j]);
-                printf("\tswitch_point_s: %d\n", switch_point_s[i][j]);
+                printf("\tpart2_3_length: %d\n", g.part2_3_length);
+                printf("\tbig_value: %d\n", g.big_value);
+                printf("\tglobal_gain: %d\n", g.global_gain);
+                printf("\tscalefac_compress: %d\n", g.scalefac_compress);
+                printf("\twindow_switching: %d\n", g.window_switching);
+                printf("\tblock_type: %d\n", g.block_type);
+                printf("\tmixed_block_flag: %d\n", g.mixed_block_flag);
                 printf("\ttable_select: ");
                 for (int k = 0; k < 3; k++) {
-                    printf("%d ", table_select[i][j][k]);
+                    printf("%d ", g.table_select[k]);
                 }
                 printf("\n\tsubblock_gain: ");
                 for (int k = 0; k < 3; k++) {
-                    printf("%d ", subblock_gain[i][j][k]);
+                    printf("%d ", g.subblock_gain[k]);
                 }
-                printf("\n\tregion0_count: %d\n", region0_count[i][j]);
-                printf("\tregion1_count: %d\n", region1_count[i][j]);
-                printf("\tpreflag: %d\n", preflag[i][j]);
-                printf("\tscalefac_scale: %d\n", scalefac_scale[i][j]);
-                printf("\tcount1table_select: %d\n", count1table_select[i][j]);
+                printf("\n\tregion0_count: %d\n", g.region0_count);
+                printf("\tregion1_count: %d\n", g.region1_count);
+                printf("\tpreflag: %d\n", g.preflag);
+                printf("\tscalefac_scale: %d\n", g.scalefac_scale);
+                printf("\tcount1table_select: %d\n", g.count1table_select);
             }
         }
     }
@@ -6,6 +6,12 @@
 #include "huffman.h"
 #include "audio_util.h"
 #include "vector.h"
+#include "resampler.h"
+#include "analytics.h"
+#include "waveform.h"
+#include "features.h"
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 
 namespace io {
@@ -55,55 +61,52 @@ namespace mp3 {
             return static_cast<LayerDesc>(layer_desc);
         }
 
-        uint32_t getBitrate() {
-            MPEGAudioVersionId version = getVersionId();
-            LayerDesc layer = getLayerDesc();
-            if (version == MPEGAudioVersionId::kVersion1) {
-                if (layer == LayerDesc::kLayer1) {
-                    return kBitRates[bitrate_ind][0]*1000;
-                }
-                if (layer == LayerDesc::kLayer2) {
-                    return kBitRates[bitrate_ind][1]*1000;
-                }
-                if (layer == LayerDesc::kLayer3) {
-                    return kBitRates[bitrate_ind][2]*1000;
-                }
-            }
-            if (version == MPEGAudioVersionId::kVersion2 || version == MPEGAudioVersionId::kVersion2_5) {
-                if (layer == LayerDesc::kLayer1) {
-                    return kBitRates[bitrate_ind][3]*1000;
-                }
-                if (layer == LayerDesc::kLayer2 || layer == LayerDesc::kLayer3) {
-                    return kBitRates[bitrate_ind][4]*1000;
-                }
-            }
-            return 0xFFFFFFFF;
+        // kHeaderTable entry for this header's version, layer, bitrate and
+        // sampling rate
+        const HeaderInfo& info() const {
+            uint32_t word;
+            memcpy(&word, this, 4);
+            return kHeaderTable.info[(word >> 10 & 0x3F) | (word >> 11 & 0x3C0)];
         }
 
-        uint32_t getSamplingRate() {
-            MPEGAudioVersionId version = getVersionId();
-            if (version == MPEGAudioVersionId::kVersion1) {
-                return kSamplingRates[sampling_rate_ind][0];
-            }
-            if (version == MPEGAudioVersionId::kVersion2) {
-                return kSamplingRates[sampling_rate_ind][1];
-            }
-            if (version == MPEGAudioVersionId::kVersion2_5) {
-                return kSamplingRates[sampling_rate_ind][2];
-            }
-            return 0xFFFFFFFF;
+        uint32_t getBitrate() const {
+            return info().bitrate;
+        }
+
+        uint32_t getSamplingRate() const {
+            return info().sampling_rate;
         }
 
         // IMPORTANT: INCLUDES HEADER LENGTH!
-        uint32_t frameLength() {
-            LayerDesc layer = getLayerDesc();
-            if (layer == LayerDesc::kLayer1) {
-                return (12 * getBitrate() / getSamplingRate() + padding_bit)*4;
-            }
-            if (layer == LayerDesc::kLayer2 || layer == LayerDesc::kLayer3) {
-                return 144 * getBitrate() / getSamplingRate() + padding_bit;
-            }
-            return 0xFFFFFFFF;
+        uint32_t frameLength() const {
+            return info().frame_length[padding_bit];
+        }
+
+        uint32_t samplesPerFrame() const {
+            return info().samples_per_frame;
+        }
+
+        // size of the layer 3 side info, not including the header or CRC
+        uint32_t sideInfoSize() const {
+            return info().side_info_size[channel_mode == 3];
+        }
+
+        // bytes of the frame that go into the bit reservoir: all but the
+        // header, CRC and side info
+        uint32_t mainDataSize() const {
+            return frameLength() - 4 - (protection_bit ? 0 : 2) - sideInfoSize();
+        }
+
+        // true if every field can be used to compute the frame length
+        bool isValid() const {
+            return frame_sync == 2047 && info().valid;
+        }
+
+        // true if the decoder can decode the frame: the side info, band
+        // tables and bit reservoir are MPEG-1 layer III only
+        bool isDecodable() const {
+            return isValid() && version_id == (uint32_t)MPEGAudioVersionId::kVersion1
+                && layer_desc == (uint32_t)LayerDesc::kLayer3;
         }
 
         uint32_t channels() {
@@ -132,6 +135,16 @@ namespace mp3 {
         }
     } __attribute__((packed));
 
+    // reverses the 4 header bytes at data into an MP3FrameHeader
+    inline MP3FrameHeader loadHeader(const uint8_t* data) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        word = __builtin_bswap32(word);
+        MP3FrameHeader header;
+        memcpy(&header, &word, 4);
+        return header;
+    }
+
     // refer to pages 13, 24-30 of the link below for more information
     // https://drive.google.com/file/d/1VpsPl6ymDb4EINK42iqzqASFgaubNYDR/view
     // also useful: http://www.mp3-tech.org/programmer/docs/mp3_theory.pdf
@@ -152,39 +165,86 @@ namespace mp3 {
     //     uint32_t subblock_gain : 10;
     // };
   
-    struct MP3SideInfo {
-        // Metadata
-        bool scfsi[2][4]; // 8 bits
-        int main_data_begin; // 9 bits; if 0, main data directly follows side info, otherwise it's a negative offset from sync word
-
-        // Actual Side info
-        // field[x][y] = field for granule x + 1, channel y + 1
-        uint32_t part2_3_length[2][2];
-        uint32_t part2_length[2][2];
-        uint32_t big_value[2][2];
-        uint32_t global_gain[2][2];
-        uint32_t scalefac_compress[2][2];
-        uint32_t slen1[2][2];
-        uint32_t slen2[2][2];
-        bool window_switching[2][2];
-        uint32_t block_type[2][2];
-        bool mixed_block_flag[2][2];
-        uint32_t switch_point_l[2][2];
-        uint32_t switch_point_s[2][2];
-        uint32_t table_select[2][2][3];
-        uint32_t subblock_gain[2][2][3];
-        uint32_t region0_count[2][2];
-        uint32_t region1_count[2][2];
-        uint32_t preflag[2][2];
-        uint32_t scalefac_scale[2][2];
-        uint32_t count1table_select[2][2];
+    // side info of one granule of one channel, 12 bytes
+    struct GranuleSideInfo {
+        uint32_t part2_3_length : 12;   // bits of scalefactors and Huffman data
+        uint32_t big_value : 9;         // pairs in the big value region
+        uint32_t scalefac_compress : 4; // index into kSlenTable
+        uint32_t block_type : 2;        // 2 is short blocks
+        uint32_t window_switching : 1;
+        uint32_t mixed_block_flag : 1;  // long blocks below band 8, short above
+        uint32_t preflag : 1;           // add kPretab to the long block scalefactors
+        uint32_t scalefac_scale : 1;
+        uint32_t count1table_select : 1;
+        uint8_t global_gain;            // quantizer step size
+        uint8_t region0_count : 4;      // scalefactor bands in the first big value region
+        uint8_t region1_count : 4;      // and in the second
+        uint8_t table_select[3];        // Huffman table per big value region
+        uint8_t subblock_gain[3];       // per short window
+    };
+
+    // the whole side info of a frame in one cache line
+    struct alignas(64) MP3SideInfo {
+        uint16_t main_data_begin; // bytes back from this frame's main data into the reservoir
+        // scfsi[ch][band]: granule 1 reuses granule 0's scalefactors for that band group
+        bool scfsi[2][4];
+        GranuleSideInfo granule[2][2]; // [granule][channel]
 
         void printSideInfo();
     };
+    static_assert(sizeof(MP3SideInfo) == 64, "side info should fill one cache line");
+
+    // outcome of a call to MP3FrameDecoder::decodeFrames
+    struct DecodeResult {
+        uint32_t frames;        // frames decoded
+        size_t bytes_consumed;  // input bytes used up, including skipped garbage
+        size_t samples;         // int16 samples written to the output (all channels)
+        AnalysisResult analysis; // totals so far, if the decoder has an analyzer
+    };
+
+    // main_data_begin (at most 511) plus the largest layer 3 frame, padded so
+    // bit reads can peek past the end
+    static const uint32_t kMaxMainDataSize = 2048;
+
+    // one decoded frame (1152 stereo samples), resampled up by as much as 3x:
+    // maxOutput(576) for each granule and channel
+    static const uint32_t kMaxFrameSamples = 4 * (3 * 576 + 1);
+
+    // snapshot layout version; bump whenever the serialized state changes
+    static const uint32_t kSnapshotMagic = 0x5333504D; // "MP3S"
+    static const uint16_t kSnapshotVersion = 3;
+    // main_data_begin is 9 bits, so no frame looks further back than this
+    static const uint32_t kMaxReservoirSize = 511;
+
+    // working buffers for one frame; nothing in here survives from one frame
+    // to the next (scfsi only reuses scalefactors within a frame), so all the
+    // decoders running on a thread share a single copy
+    struct alignas(64) DecoderScratch {
+        float samples [2][2][576];
+        alignas(64) int scalefac_l [2][2][22];
+        int scalefac_s [2][2][13][3]; // band major, the order they are coded and requantized in
+        alignas(64) uint8_t main_data [kMaxMainDataSize];
+        alignas(64) int16_t pcm [kMaxFrameSamples];
+        MP3SideInfo side_info;
+
+        // the calling thread's scratch
+        static DecoderScratch& get();
+    };
 
+    // Per-stream state, about 13.4 KB (see bench_footprint for the exact
+    // number on a given build), so 50k streams fit in ~700 MB:
+    //   hot:  synthesis FIFO (8 KB) and IMDCT overlap (4.5 KB), 64 byte aligned
+    //   cold: bit reservoir (511 bytes), header, band tables, scratch pointers
+    // Huffman trees are shared by all decoders and per-frame buffers live in
+    // the thread's DecoderScratch.
     struct MP3FrameDecoder {
+        // hot: read and written for every granule
+        alignas(64) float fifo [2][1024];
+        alignas(64) float prev_samples [2][32][18];
+
         // header and info from header
         MP3FrameHeader* header;
+        MP3FrameHeader frame_header;
         struct {
             const unsigned *long_win;
             const unsigned *short_win;
@@ -193,38 +253,102 @@ namespace mp3 {
             const unsigned *long_win;
             const unsigned *short_win;
         } band_width;
+        const uint16_t* reorder_source; // kReorderTables row for the sampling rate
 
-        // side info and info from side info
-        MP3SideInfo* side_info;
-        HuffmanTree* tables [kNumHuffmanTables];
-
-        // other decoding stuffs
-        int scalefac_l [2][2][22];
-        int scalefac_s [2][2][3][13];
-
-        float prev_samples [2][32][18];
-        float fifo [2][1024];
+        // tail of the main data seen so far, for main_data_begin to point into
+        uint32_t reservoir_size;
+        uint8_t reservoir [kMaxReservoirSize];
 
-        util::Vector<uint8_t> main_data_buffer;
-        float samples [2][2][576];
-        int16_t pcm [2304];
-
-        static const int num_prev_frames = 9;
-        int prev_frame_size [num_prev_frames];
+        // point into the DecoderScratch of the thread that decodes the
+        // current frame (rebound by decodeFrame)
+        MP3SideInfo* side_info;
+        float (*samples) [2][576];
+        int (*scalefac_l) [2][22];
+        int (*scalefac_s) [2][13][3];
+        uint8_t* main_data;
+        int16_t* pcm;
+
+        // optional, owned by the caller: when set, each granule is resampled
+        // straight out of the synthesis filterbank instead of interleaved
+        Resampler* resampler;
+        // optional, owned by the caller: fed every granule and all output
+        PCMAnalyzer* analyzer;
+        // optional, owned by the caller: fed every granule's synthesis output
+        WaveformBuilder* waveform;
+        uint32_t out_samples; // int16 samples the last decodeFrame wrote (all channels)
 
         MP3FrameDecoder();
         ~MP3FrameDecoder();
 
+        void bindScratch();
         void getHeader(uint8_t* data);
         void postHeaderSetup();
 
         uint32_t readFrame(uint8_t* data);
+        uint32_t decodeFrame(uint8_t* data, int16_t* out);
+
+        // the resampler's rate must match the stream's; after a seek, reset it
+        // to the new position (resampler->reset(sample)) along with the decoder.
+        // false, leaving no resampler set, if it upsamples by more than 3x:
+        // readFrame's scratch buffer holds kMaxFrameSamples
+        bool setResampler(Resampler* resampler) {
+            this->resampler = resampler;
+            if (maxFrameSamples() <= kMaxFrameSamples) return true;
+            this->resampler = nullptr;
+            return false;
+        }
+        void setAnalyzer(PCMAnalyzer* analyzer) { this->analyzer = analyzer; }
+        void setWaveform(WaveformBuilder* waveform) { this->waveform = waveform; }
+        // room decodeFrame needs in out: 2304, or more when upsampling
+        uint32_t maxFrameSamples() { return resampler ? max<uint32_t>(2304, resampler->maxOutput(576) * 4) : 2304; }
+
+        // decodes up to max_frames whole frames from input straight into out
+        // (out_samples per frame, 2304 without a resampler); stops early when the input runs out or out
+        // has no room for another frame, so the caller can refill and call again
+        DecodeResult decodeFrames(uint8_t* input, size_t input_size, int16_t* out,
+                                  size_t out_size, uint32_t max_frames);
+
+        // feature-extraction mode: runs a frame only up to its spectral lines
+        // (requantize, stereo, reorder) and turns each granule into
+        // GranuleFeatures, skipping the IMDCT and synthesis; out holds 2.
+        // The overlap and synthesis state are not updated, so restore or
+        // reset the decoder before decoding PCM with it again
+        uint32_t extractFrameFeatures(uint8_t* data, FeatureExtractor& extractor, GranuleFeatures* out);
+        // like decodeFrames, writing up to max_granules granules (samples in
+        // the result counts granules)
+        DecodeResult extractFeatures(uint8_t* input, size_t input_size, FeatureExtractor& extractor,
+                                     GranuleFeatures* out, size_t max_granules);
+
+        // cross-frame state (overlap, synthesis FIFO, bit reservoir, last
+        // header) in native byte order; snapshot returns
+        // the bytes written or 0 if size < snapshotSize(), restore returns
+        // false (leaving the decoder untouched) for a foreign or corrupt snapshot
+        size_t snapshotSize();
+        size_t snapshot(uint8_t* out, size_t size);
+        bool restore(const uint8_t* in, size_t size);
 
         void setSideInfo(uint8_t* buffer);
-        void setMainData(uint8_t* buffer);
+        bool setMainData(uint8_t* buffer);
+        // the reservoir half of setMainData: assembles this frame's main data
+        // and keeps the tail, without unpacking anything
+        bool loadMainData(uint8_t* buffer);
         void unpackScalefacs(uint8_t* data, uint32_t granule, uint32_t channel, int &bit);
         void unpackSamples(uint8_t* main_data, int gr, int ch, int bit, int max_bit);
 
+        // everything after Huffman decoding for one granule, leaving its PCM
+        // in samples. Fused: one pass requantizes both channels and applies
+        // mid/side stereo, then each subband goes through reorder (or alias
+        // reduction), IMDCT and frequency inversion while it is in registers,
+        // into an L1-sized buffer that synthesis reads. Same output as the
+        // staged functions below, which feature extraction, scan and
+        // bench_stages use.
+        void transformGranule(uint32_t granule);
+        // requantizes both channels and applies mid/side stereo
+        void requantizeGranule(uint32_t granule);
+        void requantizeChannel(uint32_t granule, uint32_t channel, bool mid_side);
+        void transformSubbands(uint32_t granule, uint32_t channel, float* out);
+        void synthFilterbank(const float* lines, uint32_t channel, float* out);
+
         void requantize(uint32_t granule, uint32_t channel);
         void midSideStereo(uint32_t granule);
         void reorder(uint32_t granule, uint32_t channel);
@@ -232,10 +356,18 @@ namespace mp3 {
         void frequencyInversion(uint32_t granule, uint32_t channel);
         void IMDCT(uint32_t granule, uint32_t channel);
         void synthFilterbank(uint32_t granule, uint32_t channel);
-        void interleave();
+        void interleave(int16_t* out);
+        void resampleGranule(uint32_t granule, int16_t* out);
+        void resampleFrame(int16_t* out);
+        void analyzeGranule(uint32_t granule);
+        void waveformGranule(uint32_t granule);
+        void spectralPower(uint32_t granule, float* power);
 
     };
 
+    // clamps a synthesis output sample to 16 bits
+    int16_t scalePCM(float sample);
+
     struct ID3 {
         uint8_t i; // == 'I'
         uint8_t d; // == 'D'
@@ -247,6 +379,14 @@ namespace mp3 {
         bool isID3() {
             return (i=='I' && d=='D' && t=='3');
         }
+
+        // size is a big endian synchsafe integer (7 bits per byte) that
+        // excludes the 10 byte header and the optional 10 byte footer
+        uint32_t tagSize() {
+            const uint8_t* s = (const uint8_t*)&size;
+            uint32_t body = (s[0] & 0x7F) << 21 | (s[1] & 0x7F) << 14 | (s[2] & 0x7F) << 7 | (s[3] & 0x7F);
+            return 10 + body + ((flags & 0x10) ? 10 : 0);
+        }
     } __attribute__((packed));
 
     class MP3 {
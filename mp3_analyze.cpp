@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "analytics.h"
+#include "mp3.h"
+#include "probe.h"
+
+using namespace io::audio::mp3;
+
+// ReplayGain-style scanner: decodes each file into a scratch buffer that is
+// thrown away (a null sink) with a PCMAnalyzer attached, and prints loudness,
+// peaks, RMS and the PCM hash.
+// usage: mp3_analyze [--envelope] [--no-true-peak] files...
+//   --envelope prints the RMS envelope (dBFS per 100 ms) after each file
+
+static double toDB(double linear) {
+    return linear > 0 ? 20 * std::log10(linear) : -HUGE_VAL;
+}
+
+int main(int argc, char** argv) {
+    bool print_envelope = false;
+    AnalyzerConfig config;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--envelope")) {
+            print_envelope = true;
+        } else if (!strcmp(argv[i], "--no-true-peak")) {
+            config.true_peak = false;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) paths.push_back("../test.mp3");
+
+    PCMAnalyzer analyzer(config);
+    std::vector<int16_t> pcm(2304 * 32);
+    for (const char* path : paths) {
+        std::ifstream ifs(path, std::ifstream::binary);
+        std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        MP3Info info;
+        if (!probe(file.data(), file.size(), &info)) {
+            printf("%s: no MP3 frames\n", path);
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        MP3FrameDecoder* decoder = new MP3FrameDecoder();
+        decoder->setAnalyzer(&analyzer);
+        analyzer.reset();
+        uint64_t offset = info.first_frame;
+        DecodeResult result = {};
+        uint32_t frames = 0;
+        while (offset < info.audio_end) {
+            result = decoder->decodeFrames(&file[offset], info.audio_end - offset, pcm.data(), pcm.size(), 32);
+            if (result.frames == 0) break;
+            frames += result.frames;
+            offset += result.bytes_consumed;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        delete decoder;
+
+        // the totals come back with every decodeFrames call
+        AnalysisResult& analysis = result.analysis;
+        double duration = (double)analysis.samples / info.sampling_rate;
+        printf("%s\n", path);
+        printf("  frames:           %u (%.1f s, decoded at %.1fx real time)\n", frames, duration, duration / seconds);
+        printf("  integrated:       %.2f LUFS\n", analysis.integrated_lufs);
+        printf("  momentary max:    %.2f LUFS\n", analysis.momentary_max_lufs);
+        printf("  replay gain:      %+.2f dB\n", analysis.replay_gain_db);
+        printf("  sample peak:      %.2f dBFS\n", toDB(analysis.sample_peak));
+        if (config.true_peak) printf("  true peak:        %.2f dBTP\n", toDB(analysis.true_peak));
+        printf("  rms:              %.2f dBFS\n", analysis.rms_db);
+        printf("  pcm hash:         %016llx\n", (unsigned long long)analysis.hash);
+        if (print_envelope) {
+            for (size_t i = 0; i < analysis.rms_envelope_size; i++) {
+                printf("%.2f%c", toDB(analysis.rms_envelope[i]), (i + 1) % 10 ? ' ' : '\n');
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "probe.h"
+#include "splice.h"
+
+using namespace io::audio::mp3;
+
+// Cuts and joins MP3 files without re-encoding.
+// usage: mp3_cut out.mp3 in.mp3 start end [in.mp3 start end ...]
+//   start and end are in seconds; "end" for end means to the end of the file
+
+static const char* kStatusNames[] = {"ok", "not an MPEG-1 layer III stream", "segments differ in format",
+                                     "empty range", "corrupt stream", "frame too large"};
+
+int main(int argc, char** argv) {
+    if (argc < 5 || (argc - 2) % 3 != 0) {
+        printf("usage: %s out.mp3 in.mp3 start end [in.mp3 start end ...]\n", argv[0]);
+        return 1;
+    }
+
+    size_t count = (argc - 2) / 3;
+    std::vector<std::vector<uint8_t>> files(count);
+    std::vector<EditSegment> segments(count);
+    for (size_t i = 0; i < count; i++) {
+        const char* path = argv[2 + 3 * i];
+        std::ifstream ifs(path, std::ifstream::binary);
+        files[i].assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        MP3Info info;
+        if (!probe(files[i].data(), files[i].size(), &info)) {
+            printf("%s: no MP3 frames\n", path);
+            return 1;
+        }
+        const char* end = argv[4 + 3 * i];
+        segments[i].data = files[i].data();
+        segments[i].size = files[i].size();
+        segments[i].start = (uint64_t)(atof(argv[3 + 3 * i]) * info.sampling_rate + 0.5);
+        segments[i].end = strcmp(end, "end") ? (uint64_t)(atof(end) * info.sampling_rate + 0.5) : ~0ULL;
+    }
+
+    std::vector<uint8_t> out;
+    EditResult result = spliceStreams(segments.data(), count, &out);
+    if (result.status != EditStatus::kOk) {
+        printf("failed: %s\n", kStatusNames[(int)result.status]);
+        return 1;
+    }
+    std::ofstream ofs(argv[1], std::ofstream::binary);
+    ofs.write((const char*)out.data(), out.size());
+
+    printf("%s: %u frames (%u moved to a higher bitrate), %llu samples, delay %u, padding %u, %zu bytes\n",
+           argv[1], result.frames, result.resized_frames, (unsigned long long)result.samples,
+           result.encoder_delay, result.encoder_padding, out.size());
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "sidecar.h"
+
+using namespace io::audio::mp3;
+
+// Builds or checks the sidecar index of an MP3 file.
+//   build: scans the file's frame headers and writes the index
+//   check: maps both files, checks the index is current (cheap edge
+//          checksum, then the full one), compares every frame against a
+//          fresh header scan and times open plus random seeks through the
+//          index against that scan
+// usage: mp3_index build|check file [index]   (index defaults to file.idx)
+
+struct MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    bool open(const char* path) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* ptr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data = (const uint8_t*)ptr;
+                size = st.st_size;
+            }
+        }
+        ::close(fd);
+        return data != nullptr;
+    }
+
+    ~MappedFile() {
+        if (data) munmap((void*)data, size);
+    }
+};
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int build(const MappedFile& source, const char* index_path) {
+    auto start = std::chrono::steady_clock::now();
+    FrameIndex index;
+    if (!buildFrameIndex(source.data, source.size, &index)) {
+        printf("no MPEG-1 layer III frames\n");
+        return 1;
+    }
+    std::vector<uint64_t> buffer((sidecarSize(index) + 7) / 8);
+    size_t size = writeSidecar(index, source.data, source.size, (uint8_t*)buffer.data(), buffer.size() * 8);
+    double ms = msSince(start);
+
+    FILE* out = fopen(index_path, "wb");
+    if (!out || fwrite(buffer.data(), 1, size, out) != size) {
+        printf("could not write %s\n", index_path);
+        return 1;
+    }
+    fclose(out);
+    printf("%s: %zu frames, %zu bytes (%.2f per frame), built in %.1f ms\n", index_path, index.numFrames(), size,
+           (double)size / index.numFrames(), ms);
+    return 0;
+}
+
+static int check(const MappedFile& source, const char* index_path) {
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file;
+    SidecarIndex sidecar;
+    if (!file.open(index_path) || !sidecar.map(file.data, file.size)) {
+        printf("%s: not a sidecar index\n", index_path);
+        return 1;
+    }
+    bool current = sidecar.quickMatch(source.data, source.size);
+    double open_ms = msSince(start);
+    if (!current) {
+        printf("%s: stale (source size or edges changed)\n", index_path);
+        return 1;
+    }
+    start = std::chrono::steady_clock::now();
+    current = sidecar.fullMatch(source.data, source.size);
+    double checksum_ms = msSince(start);
+    if (!current) {
+        printf("%s: stale (source checksum changed)\n", index_path);
+        return 1;
+    }
+
+    // seek to random samples: frame, its offset and where priming starts
+    const SidecarHeader* info = sidecar.info();
+    uint64_t total = info->num_frames * info->samples_per_frame;
+    std::mt19937_64 rng(1);
+    const int kSeeks = 100000;
+    uint64_t sink = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < kSeeks; i++) {
+        uint64_t frame = min(sidecar.frameForSample(rng() % total), sidecar.numFrames() - 1);
+        sink += sidecar.frameOffset(frame) + sidecar.primeFrame(frame);
+    }
+    double seek_ns = msSince(start) * 1e6 / kSeeks;
+
+    start = std::chrono::steady_clock::now();
+    FrameIndex scanned;
+    buildFrameIndex(source.data, source.size, &scanned);
+    double scan_ms = msSince(start);
+
+    uint64_t bad = 0;
+    if (scanned.offsets.size() != sidecar.numFrames()) bad++;
+    for (uint64_t i = 0; !bad && i < sidecar.numFrames(); i++) {
+        uint64_t offset = scanned.offsets[i];
+        MP3FrameHeader expected = loadHeader(source.data + offset);
+        MP3FrameHeader indexed = sidecar.frameHeader(i);
+        const uint8_t* side_info = source.data + offset + 4 + (expected.protection_bit ? 0 : 2);
+        if (sidecar.frameOffset(i) != offset || indexed.frameLength() != expected.frameLength()
+            || indexed.sideInfoSize() != expected.sideInfoSize()
+            || sidecar.mainDataBegin(i) != (uint32_t)(side_info[0] << 1 | side_info[1] >> 7)) {
+            bad++;
+        }
+    }
+
+    printf("%s: %llu frames, %u Hz, channel mode %u, %s\n", index_path, (unsigned long long)info->num_frames,
+           info->sampling_rate, info->channel_mode, bad ? "MISMATCH with a header scan" : "matches a header scan");
+    printf("  open and quick check %.3f ms, full checksum %.1f ms\n", open_ms, checksum_ms);
+    printf("  seek %.0f ns (checksum %llx), header scan %.1f ms\n", seek_ns, (unsigned long long)(sink & 0xFFFF),
+           scan_ms);
+    return bad ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3 || (strcmp(argv[1], "build") && strcmp(argv[1], "check"))) {
+        printf("usage: mp3_index build|check file [index]\n");
+        return 1;
+    }
+    std::string index_path = argc > 3 ? argv[3] : std::string(argv[2]) + ".idx";
+    MappedFile source;
+    if (!source.open(argv[2])) {
+        printf("could not open %s\n", argv[2]);
+        return 1;
+    }
+    return !strcmp(argv[1], "build") ? build(source, index_path.c_str()) : check(source, index_path.c_str());
+}
@@ -0,0 +1,217 @@
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+// Load generator for mp3_server: opens N connections, streams an MP3 file
+// over each (at a fixed bitrate or as fast as the server takes it) and
+// drains the PCM that comes back, all from one epoll thread.
+
+struct Connection {
+    int fd = -1;
+    size_t sent = 0;
+    uint64_t received = 0;
+    bool closed = false;
+};
+
+static uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int connectTo(const std::string& tcp, const std::string& unix_path) {
+    int fd;
+    int ret;
+    if (!unix_path.empty()) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, unix_path.c_str(), sizeof(addr.sun_path) - 1);
+        ret = connect(fd, (sockaddr*)&addr, sizeof(addr));
+    } else {
+        size_t colon = tcp.find(':');
+        std::string host = colon == std::string::npos ? "127.0.0.1" : tcp.substr(0, colon);
+        int port = atoi(colon == std::string::npos ? tcp.c_str() : tcp.c_str() + colon + 1);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+        ret = connect(fd, (sockaddr*)&addr, sizeof(addr));
+    }
+    if (ret != 0) {
+        close(fd);
+        return -1;
+    }
+    // connect blocking, then do everything else without blocking
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void usage() {
+    printf("usage: mp3_loadgen [--tcp HOST:PORT | --unix PATH] [--streams N] [--file F]\n"
+           "                   [--kbps RATE] [--seconds S]\n"
+           "  --kbps sends each stream at RATE kbit/s (its real-time rate), default unpaced\n");
+}
+
+int main(int argc, char** argv) {
+    std::string tcp = "127.0.0.1:8000";
+    std::string unix_path;
+    std::string path = "../test.mp3";
+    int num_streams = 100;
+    double kbps = 0;
+    double max_seconds = 0;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (!strcmp(argv[i], "--tcp")) {
+            tcp = argv[++i];
+        } else if (!strcmp(argv[i], "--unix")) {
+            unix_path = argv[++i];
+        } else if (!strcmp(argv[i], "--streams")) {
+            num_streams = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--file")) {
+            path = argv[++i];
+        } else if (!strcmp(argv[i], "--kbps")) {
+            kbps = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--seconds")) {
+            max_seconds = atof(argv[++i]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if (file.empty()) {
+        fprintf(stderr, "could not read %s\n", path.c_str());
+        return 1;
+    }
+
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    int epoll_fd = epoll_create1(0);
+    std::vector<Connection> connections(num_streams);
+    for (int i = 0; i < num_streams; i++) {
+        connections[i].fd = connectTo(tcp, unix_path);
+        if (connections[i].fd < 0) {
+            fprintf(stderr, "connection %d failed: %s\n", i, strerror(errno));
+            return 1;
+        }
+        epoll_event event;
+        event.events = (uint32_t)EPOLLIN | (kbps > 0 ? 0 : (uint32_t)EPOLLOUT);
+        event.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connections[i].fd, &event);
+    }
+    fprintf(stderr, "%d streams connected\n", num_streams);
+
+    // pushes as much of the file as the pacing (and the socket) allows;
+    // once everything is out, half-close so the server sees the end
+    auto sendSome = [&](Connection& conn, size_t allowed) {
+        size_t target = allowed < file.size() ? allowed : file.size();
+        while (conn.sent < target) {
+            ssize_t ret = send(conn.fd, file.data() + conn.sent, target - conn.sent, MSG_NOSIGNAL);
+            if (ret <= 0) break;
+            conn.sent += ret;
+        }
+        return conn.sent == file.size();
+    };
+
+    uint8_t buffer[65536];
+    uint64_t start = nowUs();
+    uint64_t last_report = start;
+    uint64_t total_received = 0;
+    int open_streams = num_streams;
+    std::vector<bool> finished_sending(num_streams, false);
+    epoll_event events[512];
+    while (open_streams > 0) {
+        double elapsed = (nowUs() - start) / 1e6;
+        if (max_seconds > 0 && elapsed >= max_seconds) break;
+
+        if (kbps > 0) {
+            // an initial burst, then the bitrate
+            size_t allowed = 65536 + (size_t)(elapsed * kbps * 1000 / 8);
+            for (int i = 0; i < num_streams; i++) {
+                if (finished_sending[i] || connections[i].closed) continue;
+                if (sendSome(connections[i], allowed)) {
+                    finished_sending[i] = true;
+                    shutdown(connections[i].fd, SHUT_WR);
+                }
+            }
+        }
+
+        int n = epoll_wait(epoll_fd, events, 512, kbps > 0 ? 10 : 1000);
+        for (int e = 0; e < n; e++) {
+            int i = events[e].data.u32;
+            Connection& conn = connections[i];
+            if (conn.closed) continue;
+            if ((events[e].events & EPOLLOUT) && !finished_sending[i]) {
+                if (sendSome(conn, file.size())) {
+                    finished_sending[i] = true;
+                    shutdown(conn.fd, SHUT_WR);
+                    epoll_event event;
+                    event.events = EPOLLIN;
+                    event.data.u32 = i;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+                }
+            }
+            if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                while (true) {
+                    ssize_t ret = read(conn.fd, buffer, sizeof(buffer));
+                    if (ret > 0) {
+                        conn.received += ret;
+                        total_received += ret;
+                        continue;
+                    }
+                    if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                        conn.closed = true;
+                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+                        close(conn.fd);
+                        open_streams--;
+                    }
+                    break;
+                }
+            }
+        }
+
+        uint64_t now = nowUs();
+        if (now - last_report >= 5000000) {
+            fprintf(stderr, "%.1fs: %d open, %.1f MB of PCM received\n",
+                    (now - start) / 1e6, open_streams, total_received / 1e6);
+            last_report = now;
+        }
+    }
+
+    double elapsed = (nowUs() - start) / 1e6;
+    uint64_t total_sent = 0;
+    for (auto& conn : connections) total_sent += conn.sent;
+    // 16 bit stereo at 44.1 kHz, the format of the test file
+    double audio_seconds = total_received / 4.0 / 44100.0;
+    printf("streams: %d (%d still open)\n", num_streams, open_streams);
+    printf("elapsed: %.2f s\n", elapsed);
+    printf("sent: %.2f MB (%.2f MB/s)\n", total_sent / 1e6, total_sent / 1e6 / elapsed);
+    printf("received: %.2f MB of PCM (%.2f MB/s)\n", total_received / 1e6, total_received / 1e6 / elapsed);
+    printf("decoded audio: %.0f s, %.1fx real time in aggregate\n", audio_seconds, audio_seconds / elapsed);
+    return 0;
+}
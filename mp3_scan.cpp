@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "probe.h"
+#include "scan.h"
+
+using namespace io::audio::mp3;
+
+// Finds silence gaps and level changes in MP3 files from headers and side
+// info only, without decoding audio.
+// usage: mp3_scan [--refine] [--silence DB] [--levels] files...
+//   --refine   Huffman-decodes frames near the silence threshold
+//   --levels   prints the estimated level of every frame
+
+int main(int argc, char** argv) {
+    ScanConfig config;
+    bool print_levels = false;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--refine")) {
+            config.refine = true;
+        } else if (!strcmp(argv[i], "--levels")) {
+            print_levels = true;
+        } else if (!strcmp(argv[i], "--silence") && i + 1 < argc) {
+            config.silence_db = atof(argv[++i]);
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty()) paths.push_back("../test.mp3");
+
+    for (const char* path : paths) {
+        std::ifstream ifs(path, std::ifstream::binary);
+        std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        MP3Info info;
+        if (!probe(file.data(), file.size(), &info)) {
+            printf("%s: no MP3 frames\n", path);
+            continue;
+        }
+
+        ScanResult result;
+        auto start = std::chrono::steady_clock::now();
+        scanStream(&file[info.audio_start], info.audio_end - info.audio_start, config, &result);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double frame_seconds = (double)result.samples_per_frame / result.sample_rate;
+        printf("%s\n", path);
+        printf("  frames: %zu (%.1f s), %u refined, scanned at %.0f MB/s\n", result.frames.size(),
+               result.frames.size() * frame_seconds, result.refined_frames,
+               (info.audio_end - info.audio_start) / 1e6 / seconds);
+        printf("  mean level: %.1f dBFS\n", result.mean_level_db);
+        for (const SilenceRun& run : result.silences) {
+            printf("  silence  %8.2f s  for %.2f s\n", run.start, run.duration);
+        }
+        for (const ChangePoint& change : result.changes) {
+            printf("  change   %8.2f s  %.1f -> %.1f dB\n", change.time, change.before_db, change.after_db);
+        }
+        if (print_levels) {
+            for (size_t i = 0; i < result.frames.size(); i++) {
+                printf("%.1f%s%c", result.frames[i].level_db, result.frames[i].refined ? "*" : "",
+                       (i + 1) % 16 ? ' ' : '\n');
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
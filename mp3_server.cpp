@@ -0,0 +1,75 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/resource.h>
+#include "stream_server.h"
+
+using namespace io::audio::mp3;
+
+static StreamServer* server = nullptr;
+
+static void onSignal(int) {
+    if (server) server->stop();
+}
+
+static void usage() {
+    printf("usage: mp3_server [--tcp PORT] [--unix PATH] [--workers N]\n"
+           "                  [--sink echo|null|DIR] [--stats SECONDS]\n");
+}
+
+int main(int argc, char** argv) {
+    StreamServerConfig config;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        if (!strcmp(argv[i], "--tcp")) {
+            config.tcp_port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--unix")) {
+            config.unix_path = argv[++i];
+        } else if (!strcmp(argv[i], "--workers")) {
+            config.num_workers = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--stats")) {
+            config.stats_interval = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--sink")) {
+            const char* sink = argv[++i];
+            if (!strcmp(sink, "echo")) {
+                config.sink = SinkMode::kEcho;
+            } else if (!strcmp(sink, "null")) {
+                config.sink = SinkMode::kNull;
+            } else {
+                config.sink = SinkMode::kFile;
+                config.sink_dir = sink;
+            }
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (config.tcp_port < 0 && config.unix_path.empty()) {
+        config.tcp_port = 8000;
+    }
+
+    // one descriptor per stream (two with a file sink)
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    server = new StreamServer(config);
+    if (!server->start()) {
+        fprintf(stderr, "could not open any listener\n");
+        return 1;
+    }
+    fprintf(stderr, "listening (tcp %d, unix '%s'), %d workers\n",
+            config.tcp_port, config.unix_path.c_str(), config.num_workers);
+    server->run();
+    delete server;
+    return 0;
+}
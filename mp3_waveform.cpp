@@ -0,0 +1,101 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "mp3.h"
+#include "probe.h"
+#include "splice.h"
+#include "waveform.h"
+
+using namespace io::audio::mp3;
+
+// Writes a min/max/RMS overview pyramid (256/1024/4096 samples per bucket)
+// of an MP3 file, built while decoding into a scratch buffer that is thrown
+// away, then reads it back through mapWaveform. With --bench it first
+// times the same decode without the overview (a null sink) and reports
+// both, best of 5.
+// usage: mp3_waveform [--bench] [file] [out]
+
+static double decodeFile(std::vector<uint8_t>& file, const MP3Info& info, WaveformBuilder* waveform) {
+    std::vector<int16_t> pcm(2304 * 32);
+    auto start = std::chrono::steady_clock::now();
+    MP3FrameDecoder* decoder = new MP3FrameDecoder();
+    decoder->setWaveform(waveform);
+    if (waveform) {
+        // bucket 0 starts at the first stream sample
+        waveform->reset(info.encoder_delay + kDecoderDelay, info.is_estimate ? UINT64_MAX : info.num_samples);
+    }
+    uint64_t offset = info.audio_start;
+    while (offset < info.audio_end) {
+        DecodeResult result = decoder->decodeFrames(&file[offset], info.audio_end - offset, pcm.data(), pcm.size(), 32);
+        if (result.frames == 0) break;
+        offset += result.bytes_consumed;
+    }
+    if (waveform) waveform->finish();
+    delete decoder;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    bool bench = false;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--bench")) {
+            bench = true;
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    const char* path = paths.size() > 0 ? paths[0] : "../test.mp3";
+    const char* out_path = paths.size() > 1 ? paths[1] : "waveform.bin";
+
+    std::ifstream ifs(path, std::ifstream::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    MP3Info info;
+    if (!probe(file.data(), file.size(), &info)) {
+        printf("%s: no MP3 frames\n", path);
+        return 1;
+    }
+
+    WaveformBuilder waveform;
+    double seconds = decodeFile(file, info, &waveform);
+    if (bench) {
+        double null_sink = decodeFile(file, info, nullptr);
+        for (int run = 1; run < 5; run++) {
+            null_sink = std::min(null_sink, decodeFile(file, info, nullptr));
+            seconds = std::min(seconds, decodeFile(file, info, &waveform));
+        }
+        printf("null sink %.1f ms, with overview %.1f ms (%+.1f%%)\n", null_sink * 1000, seconds * 1000,
+               (seconds / null_sink - 1) * 100);
+    }
+
+    // 8-byte aligned, as a mapping would be
+    std::vector<uint64_t> buffer((waveform.fileSize() + 7) / 8);
+    uint8_t* bytes = (uint8_t*)buffer.data();
+    size_t size = waveform.writeFile(bytes, buffer.size() * 8);
+    FILE* out = fopen(out_path, "wb");
+    if (!out || fwrite(bytes, 1, size, out) != size) {
+        printf("could not write %s\n", out_path);
+        return 1;
+    }
+    fclose(out);
+
+    const WaveformHeader* header = mapWaveform(bytes, size);
+    if (!header) {
+        printf("%s: not a valid overview\n", out_path);
+        return 1;
+    }
+    printf("%s: %llu samples, %u channels, %zu bytes\n", out_path, (unsigned long long)header->samples,
+           header->channels, size);
+    for (uint32_t level = 0; level < header->num_levels; level++) {
+        const WaveformLevel& info = header->levels[level];
+        const WaveformBucket* buckets = waveformLevel(header, level);
+        int16_t peak = 0;
+        for (uint64_t i = 0; i < info.buckets * header->channels; i++)
+            peak = std::max<int16_t>(peak, std::max<int16_t>(buckets[i].max, -buckets[i].min));
+        printf("  %5u samples per bucket: %llu buckets, peak %d\n", info.samples_per_bucket,
+               (unsigned long long)info.buckets, peak);
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "pcm_cache.h"
+#include "mp3.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    PCMCache::PCMCache(const PCMCacheConfig& config) : config(config), resumed(0), prerolled(0) {
+        if (this->config.num_shards == 0) this->config.num_shards = 1;
+        if (this->config.frames_per_chunk == 0) this->config.frames_per_chunk = 1;
+        shard_bytes = this->config.max_bytes / this->config.num_shards;
+        shards.reset(new Shard[this->config.num_shards]);
+    }
+
+    std::shared_ptr<const PCMChunk> PCMCache::lookup(const Key& key, bool count) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end()) {
+            if (count) shard.misses++;
+            return nullptr;
+        }
+        if (count) shard.hits++;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->second;
+    }
+
+    std::shared_ptr<const PCMChunk> PCMCache::find(uint64_t file, uint64_t chunk) {
+        return lookup({file, chunk}, true);
+    }
+
+    void PCMCache::insert(uint64_t file, uint64_t chunk, std::shared_ptr<const PCMChunk> value) {
+        size_t bytes = value->bytes();
+        if (bytes > shard_bytes) return;
+
+        Key key = {file, chunk};
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> guard(shard.lock);
+        // another thread may have decoded the same chunk meanwhile
+        if (shard.entries.count(key)) return;
+
+        while (shard.bytes + bytes > shard_bytes) {
+            auto& oldest = shard.lru.back();
+            shard.bytes -= oldest.second->bytes();
+            shard.entries.erase(oldest.first);
+            shard.lru.pop_back();
+            shard.evictions++;
+        }
+        shard.lru.emplace_front(key, std::move(value));
+        shard.entries[key] = shard.lru.begin();
+        shard.bytes += bytes;
+    }
+
+    void PCMCache::eraseFile(uint64_t file) {
+        for (uint32_t i = 0; i < config.num_shards; i++) {
+            Shard& shard = shards[i];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            for (auto it = shard.lru.begin(); it != shard.lru.end();) {
+                if (it->first.file != file) {
+                    ++it;
+                    continue;
+                }
+                shard.bytes -= it->second->bytes();
+                shard.entries.erase(it->first);
+                it = shard.lru.erase(it);
+            }
+        }
+    }
+
+    PCMCacheStats PCMCache::stats() {
+        PCMCacheStats stats = {0, 0, 0, resumed.load(), prerolled.load(), 0, 0};
+        for (uint32_t i = 0; i < config.num_shards; i++) {
+            Shard& shard = shards[i];
+            std::lock_guard<std::mutex> guard(shard.lock);
+            stats.hits += shard.hits;
+            stats.misses += shard.misses;
+            stats.evictions += shard.evictions;
+            stats.bytes += shard.bytes;
+            stats.chunks += shard.entries.size();
+        }
+        return stats;
+    }
+
+    std::shared_ptr<const PCMChunk> PCMCache::decodeChunk(uint64_t file, const uint8_t* data,
+                                                          const FrameIndex& index, uint64_t chunk,
+                                                          RangeResult* result) {
+        uint64_t first = chunk * config.frames_per_chunk;
+        uint64_t last = min<uint64_t>(first + config.frames_per_chunk, index.numFrames());
+
+        // start from where the previous chunk left the decoder if it is
+        // cached (not counted as a hit: the caller did not ask for it)
+        MP3FrameDecoder* decoder = new MP3FrameDecoder();
+        std::shared_ptr<const PCMChunk> previous = chunk ? lookup({file, chunk - 1}, false) : nullptr;
+        if (previous && decoder->restore(previous->end_state.data(), previous->end_state.size())) {
+            resumed++;
+        } else {
+            prerollTo(decoder, data, index, first, result);
+            prerolled++;
+        }
+
+        std::shared_ptr<PCMChunk> value = std::make_shared<PCMChunk>();
+        value->pcm.resize((last - first) * 2304);
+        for (uint64_t i = first; i < last; i++) {
+            uint8_t* frame = (uint8_t*)data + index.frameOffset(i);
+            decoder->getHeader(frame);
+            decoder->decodeFrame(frame, value->pcm.data() + (i - first) * 2304);
+            result->frames_decoded++;
+        }
+        value->end_state.resize(decoder->snapshotSize());
+        decoder->snapshot(value->end_state.data(), value->end_state.size());
+        delete decoder;
+
+        insert(file, chunk, value);
+        return value;
+    }
+
+    RangeResult PCMCache::decodeRange(uint64_t file, const uint8_t* data, const FrameIndex& index, uint64_t start,
+                                      uint64_t end, std::vector<int16_t>* out) {
+        RangeResult result = {RangeStatus::kOk, 0, 0, 0};
+        out->clear();
+
+        // chunks hold 2304 int16 per frame, which assumes 1152 samples per frame
+        uint64_t first_sample, end_sample;
+        if (index.samples_per_frame != 1152 || !index.outputRange(start, end, &first_sample, &end_sample)) {
+            result.status = RangeStatus::kEmptyRange;
+            return result;
+        }
+        uint64_t chunk_samples = (uint64_t)config.frames_per_chunk * 1152;
+
+        out->resize((end_sample - first_sample) * 2);
+        for (uint64_t chunk = first_sample / chunk_samples; chunk <= (end_sample - 1) / chunk_samples; chunk++) {
+            std::shared_ptr<const PCMChunk> value = find(file, chunk);
+            if (!value) value = decodeChunk(file, data, index, chunk, &result);
+
+            // the part of this chunk's samples inside the range
+            uint64_t chunk_start = chunk * chunk_samples;
+            uint64_t from = max(first_sample, chunk_start);
+            uint64_t to = min(end_sample, chunk_start + value->pcm.size() / 2);
+            memcpy(out->data() + (from - first_sample) * 2, value->pcm.data() + (from - chunk_start) * 2,
+                   (to - from) * 2 * sizeof(int16_t));
+        }
+
+        result.samples = end_sample - first_sample;
+        return result;
+    }
+
+    bool PCMCache::decodeFrame(uint64_t file, const uint8_t* data, const FrameIndex& index, uint64_t frame,
+                               int16_t* out) {
+        if (index.samples_per_frame != 1152 || frame >= index.numFrames()) return false;
+        uint64_t chunk = frame / config.frames_per_chunk;
+        std::shared_ptr<const PCMChunk> value = find(file, chunk);
+        if (!value) {
+            RangeResult result = {};
+            value = decodeChunk(file, data, index, chunk, &result);
+        }
+        memcpy(out, value->pcm.data() + (frame - chunk * config.frames_per_chunk) * 2304, 2304 * sizeof(int16_t));
+        return true;
+    }
+
+}
+
+}
+
+}
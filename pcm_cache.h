@@ -0,0 +1,130 @@
+#ifndef INCLUDE_KERNEL_IO_PCM_CACHE_H_
+#define INCLUDE_KERNEL_IO_PCM_CACHE_H_
+
+#include "stdint.h"
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "range.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    struct PCMCacheConfig {
+        size_t max_bytes = 256 << 20;    // PCM and decoder state over all shards
+        uint32_t num_shards = 16;        // each with its own lock and 1/num_shards of max_bytes
+        uint32_t frames_per_chunk = 32;  // ~0.8 s at 44.1 kHz, 147 KB of PCM
+    };
+
+    // output samples of frames [chunk, chunk + 1) * frames_per_chunk of one
+    // file, as a decode from the first frame produces them
+    struct PCMChunk {
+        std::vector<int16_t> pcm;       // interleaved stereo, 2304 per frame
+        std::vector<uint8_t> end_state; // decoder snapshot after the chunk's last frame
+
+        // counted against max_bytes
+        size_t bytes() const { return sizeof(PCMChunk) + pcm.size() * sizeof(int16_t) + end_state.size(); }
+    };
+
+    struct PCMCacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t resumed;   // misses decoded from the previous chunk's end_state
+        uint64_t prerolled; // misses that went through prerollTo instead
+        uint64_t bytes;
+        uint64_t chunks;
+
+        double hitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0; }
+    };
+
+    // Shared, memory-bounded LRU of decoded PCM, keyed by a caller-chosen
+    // file id (anything that changes when the file does, e.g. a hash of
+    // path, size and mtime) and a chunk of frames_per_chunk frames. Each
+    // shard has its own lock, list and byte budget; a lookup holds the lock
+    // only to find and touch the entry, and chunks are handed out as
+    // shared_ptr so eviction never frees PCM a reader is still copying.
+    // All members may be called from any number of threads.
+    // It serves random access (decodeRange, decodeFrame), which knows the
+    // file and frame numbers. Streaming decodes (decodeFrames, PCMFramer,
+    // PCMRing) see only bytes and decode each frame once, so they bypass it.
+    class PCMCache {
+        struct Key {
+            uint64_t file;
+            uint64_t chunk;
+            bool operator==(const Key& other) const { return file == other.file && chunk == other.chunk; }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& key) const {
+                uint64_t hash = (key.file ^ (key.chunk * 0x9E3779B97F4A7C15ull)) * 0xBF58476D1CE4E5B9ull;
+                return hash ^ (hash >> 31);
+            }
+        };
+
+        typedef std::list<std::pair<Key, std::shared_ptr<const PCMChunk>>> LRUList;
+
+        struct Shard {
+            std::mutex lock;
+            LRUList lru;  // most recently used first
+            std::unordered_map<Key, LRUList::iterator, KeyHash> entries;
+            size_t bytes = 0;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+        };
+
+        PCMCacheConfig config;
+        size_t shard_bytes;
+        std::unique_ptr<Shard[]> shards;
+        std::atomic<uint64_t> resumed;
+        std::atomic<uint64_t> prerolled;
+
+        Shard& shardFor(const Key& key) { return shards[KeyHash()(key) % config.num_shards]; }
+        std::shared_ptr<const PCMChunk> lookup(const Key& key, bool count);
+        std::shared_ptr<const PCMChunk> decodeChunk(uint64_t file, const uint8_t* data, const FrameIndex& index,
+                                                    uint64_t chunk, RangeResult* result);
+
+    public:
+        explicit PCMCache(const PCMCacheConfig& config = PCMCacheConfig());
+
+        uint32_t framesPerChunk() const { return config.frames_per_chunk; }
+
+        // the cached chunk (counted as a hit and moved to the front) or
+        // nullptr (counted as a miss)
+        std::shared_ptr<const PCMChunk> find(uint64_t file, uint64_t chunk);
+        // keeps an existing entry for the key; chunks larger than a shard's
+        // budget are not cached
+        void insert(uint64_t file, uint64_t chunk, std::shared_ptr<const PCMChunk> value);
+        // drops every chunk of file, e.g. after it changed on disk
+        void eraseFile(uint64_t file);
+        PCMCacheStats stats();
+
+        // decodeRange (range.h) through the cache: chunks overlapping the
+        // range are copied out of the cache, and the missing ones decoded
+        // and inserted. A miss whose previous chunk is cached resumes from
+        // that chunk's end_state with no pre-roll or reservoir priming.
+        // frames_decoded in the result counts only decoding done by this call.
+        RangeResult decodeRange(uint64_t file, const uint8_t* data, const FrameIndex& index, uint64_t start,
+                                uint64_t end, std::vector<int16_t>* out);
+        // the 2304 samples frame of index decodes to, as decodeFrame would
+        // write them in a decode from the first frame: copied from the
+        // cache on a hit (no decoding at all), else decoded with its chunk;
+        // false if frame is past the index
+        bool decodeFrame(uint64_t file, const uint8_t* data, const FrameIndex& index, uint64_t frame, int16_t* out);
+    };
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_PCM_CACHE_H_
@@ -0,0 +1,141 @@
+#include "pcm_ring.h"
+#include <cstring>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    PCMRing::PCMRing(ByteSource& source, const PCMRingConfig& config)
+        : config(config), source(source), tail(0), head(0), finished(false), stopping(false),
+          producer_waiting(false), consumer_waiting(false), producer_wake(0), consumer_wake(0) {
+        // a power of two of at least 2, with low_water < high_water <= capacity
+        uint32_t capacity = 2;
+        while (capacity < this->config.capacity) capacity <<= 1;
+        this->config.capacity = capacity;
+        if (this->config.high_water == 0 || this->config.high_water > capacity) this->config.high_water = capacity;
+        if (this->config.low_water >= this->config.high_water) this->config.low_water = this->config.high_water - 1;
+
+        framer = new PCMFramer();
+        slots = new Slot[capacity];
+    }
+
+    PCMRing::~PCMRing() {
+        stop();
+        delete[] slots;
+        delete framer;
+    }
+
+    void PCMRing::start() {
+        if (!thread.joinable()) thread = std::thread(&PCMRing::run, this);
+    }
+
+    void PCMRing::stop() {
+        stopping.store(true);
+        wake(producer_wake);
+        if (thread.joinable()) thread.join();
+    }
+
+    void PCMRing::wake(std::atomic<uint32_t>& counter) {
+        counter.fetch_add(1);
+        counter.notify_one();
+    }
+
+    bool PCMRing::waitForRoom(uint32_t pushed) {
+        if (pushed - head_cache < config.high_water) return true;
+        head_cache = head.load(std::memory_order_acquire);
+        if (pushed - head_cache < config.high_water) return true;
+
+        // full: sleep until the consumer has drained the ring to low_water.
+        // Announcing the wait and then rereading head (both seq_cst) pairs
+        // with pop's store of head and read of producer_waiting, so either
+        // this sees the pop or pop sees the waiter.
+        while (pushed - head_cache > config.low_water) {
+            uint32_t ticket = producer_wake.load();
+            producer_waiting.store(true);
+            head_cache = head.load();
+            if (stopping.load()) break;
+            if (pushed - head_cache > config.low_water) producer_wake.wait(ticket);
+            producer_waiting.store(false, std::memory_order_relaxed);
+            head_cache = head.load(std::memory_order_acquire);
+        }
+        producer_waiting.store(false, std::memory_order_relaxed);
+        return !stopping.load(std::memory_order_relaxed);
+    }
+
+    void PCMRing::run() {
+        uint32_t pushed = 0;
+        while (!stopping.load(std::memory_order_relaxed)) {
+            PCMFramer::Status status = framer->decodeNext();
+            if (status == PCMFramer::Status::kEnd) break;
+            if (status == PCMFramer::Status::kNeedInput) {
+                size_t size;
+                uint8_t* space = framer->space(&size);
+                size_t read = source.read(space, size);
+                if (read > 0) {
+                    framer->commit(read);
+                } else if (source.eof()) {
+                    framer->finish();
+                } else {
+                    std::this_thread::yield();
+                }
+                continue;
+            }
+
+            for (uint32_t i = 0; i < framer->numBlocks(config.granularity); i++) {
+                if (!waitForRoom(pushed)) break;
+                PCMBlock block = framer->block(config.granularity, i);
+                Slot& slot = slots[pushed & (config.capacity - 1)];
+                memcpy(slot.samples, block.samples, block.length * block.channels * sizeof(int16_t));
+                slot.block = block;
+                slot.block.samples = slot.samples;
+
+                tail.store(++pushed);
+                if (consumer_waiting.load()) wake(consumer_wake);
+            }
+        }
+        finished.store(true);
+        wake(consumer_wake);
+    }
+
+    const PCMBlock* PCMRing::peek() {
+        uint32_t popped = head.load(std::memory_order_relaxed);
+        if (popped == tail_cache) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (popped == tail_cache) return nullptr;
+        }
+        return &slots[popped & (config.capacity - 1)].block;
+    }
+
+    const PCMBlock* PCMRing::wait() {
+        while (true) {
+            if (const PCMBlock* block = peek()) return block;
+            if (finished.load(std::memory_order_acquire)) {
+                // the last blocks may have landed after peek looked
+                const PCMBlock* block = peek();
+                return block;
+            }
+
+            // the same handshake as waitForRoom, against run's store of tail
+            uint32_t ticket = consumer_wake.load();
+            consumer_waiting.store(true);
+            tail_cache = tail.load();
+            if (head.load(std::memory_order_relaxed) == tail_cache && !finished.load()) consumer_wake.wait(ticket);
+            consumer_waiting.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void PCMRing::pop() {
+        uint32_t popped = head.load(std::memory_order_relaxed) + 1;
+        head.store(popped);
+        if (producer_waiting.load() && tail.load(std::memory_order_acquire) - popped <= config.low_water) {
+            wake(producer_wake);
+        }
+    }
+
+}
+
+}
+
+}
@@ -0,0 +1,103 @@
+#ifndef INCLUDE_KERNEL_IO_PCM_RING_H_
+#define INCLUDE_KERNEL_IO_PCM_RING_H_
+
+#include "stdint.h"
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include "pcm_stream.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    struct PCMRingConfig {
+        uint32_t capacity = 64;     // blocks, a power of two
+        uint32_t high_water = 48;   // the decode thread sleeps once this many blocks are queued...
+        uint32_t low_water = 32;    // ...until the consumer has drained the ring to this many
+        PCMGranularity granularity = PCMGranularity::kFrame;
+    };
+
+    // Decodes ahead of the consumer on a thread of its own, into a
+    // single-producer/single-consumer ring of PCM blocks:
+    //
+    //     PCMRing ring(source);
+    //     ring.start();
+    //     while (const PCMBlock* block = ring.wait()) {
+    //         play(*block);
+    //         ring.pop();
+    //     }
+    //
+    // Slots are allocated up front and the two sides share only the head
+    // and tail indices, each on its own cache line, so neither takes a lock
+    // or allocates once running. A side with nothing to do sleeps in
+    // std::atomic::wait (a futex) and is woken only when the other side
+    // crosses the water mark it is waiting for, not on every block.
+    // The source is read only by the decode thread; a source that returns
+    // 0 before eof() makes it yield and try again.
+    class PCMRing {
+        struct alignas(64) Slot {
+            PCMBlock block;
+            int16_t samples[2304];
+        };
+
+        PCMRingConfig config;
+        ByteSource& source;
+        PCMFramer* framer;
+        Slot* slots;
+        std::thread thread;
+
+        // written by the producer for every block
+        alignas(64) std::atomic<uint32_t> tail;  // blocks pushed
+        uint32_t head_cache = 0;                 // the producer's last look at head
+
+        // written by the consumer for every block
+        alignas(64) std::atomic<uint32_t> head;  // blocks popped
+        uint32_t tail_cache = 0;                 // the consumer's last look at tail
+
+        // written only around sleeping, waking and stopping
+        alignas(64) std::atomic<bool> finished;  // tail is final
+        std::atomic<bool> stopping;
+        std::atomic<bool> producer_waiting;
+        std::atomic<bool> consumer_waiting;
+        std::atomic<uint32_t> producer_wake;     // bumped to wake a sleeping side
+        std::atomic<uint32_t> consumer_wake;
+
+        void run();
+        // true once there is room for another block, sleeping through
+        // high_water down to low_water; false when stopping
+        bool waitForRoom(uint32_t pushed);
+        void wake(std::atomic<uint32_t>& counter);
+
+    public:
+        PCMRing(ByteSource& source, const PCMRingConfig& config = PCMRingConfig());
+        ~PCMRing();
+
+        // starts the decode thread
+        void start();
+        // stops and joins it (the destructor does too)
+        void stop();
+
+        // the oldest decoded block, or nullptr if none is ready; never blocks
+        const PCMBlock* peek();
+        // like peek, but sleeps until the decode thread has a block; nullptr
+        // only at the end of the stream
+        const PCMBlock* wait();
+        // releases the block peek or wait returned; its samples are reused
+        void pop();
+
+        // blocks decoded and not yet popped
+        uint32_t buffered() { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed); }
+        // the decode thread has reached the end of the stream and every block has been popped
+        bool done() { return finished.load(std::memory_order_acquire) && buffered() == 0; }
+    };
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_PCM_RING_H_
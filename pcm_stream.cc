@@ -0,0 +1,141 @@
+#include "pcm_stream.h"
+#include <cstring>
+#include "audio_util.h"
+#include "sync.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    size_t MemorySource::read(uint8_t* out, size_t size) {
+        size_t count = min(size, this->size - offset);
+        memcpy(out, data + offset, count);
+        offset += count;
+        return count;
+    }
+
+    void FeedSource::push(const uint8_t* data, size_t size) {
+        // drop what has been read before growing
+        if (offset > 0 && offset == buffer.size()) {
+            buffer.clear();
+            offset = 0;
+        }
+        buffer.insert(buffer.end(), data, data + size);
+    }
+
+    size_t FeedSource::read(uint8_t* out, size_t size) {
+        size_t count = min(size, buffer.size() - offset);
+        memcpy(out, buffer.data() + offset, count);
+        offset += count;
+        return count;
+    }
+
+    uint8_t* PCMFramer::space(size_t* size) {
+        if (begin > 0) {
+            memmove(input, input + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        *size = kInputBufferSize - end;
+        return input + end;
+    }
+
+    void PCMFramer::commit(size_t size) {
+        end += size;
+    }
+
+    PCMFramer::Status PCMFramer::decodeNext() {
+        while (true) {
+            uint8_t* frame = input + begin;
+            size_t available = end - begin;
+
+            if (!synced) {
+                size_t offset;
+                SyncResult sync = findFrame(frame, available, &offset, kDefaultChainLength, eof);
+                begin += offset;
+                if (sync == SyncResult::kFound) {
+                    synced = true;
+                    continue;
+                }
+            } else if (available >= 4) {
+                MP3FrameHeader next = loadHeader(frame);
+                if (!next.isValid()) {
+                    synced = false;
+                    continue;
+                }
+                uint32_t frame_size = next.frameLength();
+                if (frame_size <= available) {
+                    decoder.getHeader(frame);
+                    if (!decoder.decodeFrame(frame, pcm)) {
+                        // another version or layer: step over it
+                        begin += frame_size;
+                        continue;
+                    }
+                    position = samples_decoded;
+                    samples_decoded += 1152;
+                    channels = decoder.header->channels();
+                    sample_rate = decoder.header->getSamplingRate();
+                    begin += frame_size;
+                    return Status::kFrame;
+                }
+            }
+
+            if (eof) return Status::kEnd;
+            // a full buffer that still holds no usable frame: drop a byte and
+            // look again rather than wait for input that can't fit
+            if (begin == 0 && end == kInputBufferSize) {
+                begin = 1;
+                synced = false;
+                continue;
+            }
+            return Status::kNeedInput;
+        }
+    }
+
+    PCMBlock PCMFramer::block(PCMGranularity granularity, uint32_t index) {
+        if (granularity == PCMGranularity::kGranule) {
+            return PCMBlock{pcm + index * 576 * channels, 576, channels, sample_rate, position + index * 576};
+        }
+        return PCMBlock{pcm, 1152, channels, sample_rate, position};
+    }
+
+    bool PCMGenerator::next() {
+        if (done()) return false;
+        handle.resume();
+        if (handle.promise().exception) std::rethrow_exception(handle.promise().exception);
+        return !handle.done() && handle.promise().current;
+    }
+
+    PCMGenerator decodePCM(ByteSource& source, PCMGranularity granularity) {
+        PCMFramer framer;
+        while (true) {
+            PCMFramer::Status status = framer.decodeNext();
+            if (status == PCMFramer::Status::kEnd) co_return;
+            if (status == PCMFramer::Status::kNeedInput) {
+                size_t size;
+                uint8_t* space = framer.space(&size);
+                size_t read = source.read(space, size);
+                if (read > 0) {
+                    framer.commit(read);
+                } else if (source.eof()) {
+                    framer.finish();
+                } else {
+                    // suspend until the consumer has fed the source
+                    co_yield nullptr;
+                }
+                continue;
+            }
+            for (uint32_t i = 0; i < framer.numBlocks(granularity); i++) {
+                PCMBlock block = framer.block(granularity, i);
+                co_yield &block;
+            }
+        }
+    }
+
+}
+
+}
+
+}
@@ -0,0 +1,278 @@
+#ifndef INCLUDE_KERNEL_IO_PCM_STREAM_H_
+#define INCLUDE_KERNEL_IO_PCM_STREAM_H_
+
+#include "stdint.h"
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
+#include <vector>
+#include "mp3.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    enum class PCMGranularity {
+        kFrame = 0, // 1152 samples per channel
+        kGranule,   // 576 samples per channel, two per frame
+    };
+
+    // a block of interleaved PCM; samples point into the stream's own buffer
+    // and stay valid until the stream is resumed
+    struct PCMBlock {
+        const int16_t* samples;
+        uint32_t length;       // samples per channel
+        uint32_t channels;
+        uint32_t sample_rate;
+        uint64_t position;     // index (per channel) of the first sample in the stream
+    };
+
+    // non-blocking byte input for decodePCM
+    class ByteSource {
+    public:
+        virtual ~ByteSource() {}
+        // copies up to size bytes into out; 0 means nothing is available right
+        // now, or nothing ever will be if eof() is true
+        virtual size_t read(uint8_t* out, size_t size) = 0;
+        virtual bool eof() = 0;
+    };
+
+    // a buffer already in memory
+    class MemorySource : public ByteSource {
+        const uint8_t* data;
+        size_t size;
+        size_t offset = 0;
+
+    public:
+        MemorySource(const uint8_t* data, size_t size) : data(data), size(size) {}
+        size_t read(uint8_t* out, size_t size) override;
+        bool eof() override { return offset == size; }
+    };
+
+    // bytes pushed by the caller as they arrive (a socket, a pipe); the
+    // generator suspends when it has used everything pushed so far
+    class FeedSource : public ByteSource {
+        std::vector<uint8_t> buffer;
+        size_t offset = 0;
+        bool closed = false;
+
+    public:
+        void push(const uint8_t* data, size_t size);
+        // no more input will come
+        void close() { closed = true; }
+        size_t read(uint8_t* out, size_t size) override;
+        bool eof() override { return closed && offset == buffer.size(); }
+    };
+
+    // The input buffer and decoder behind both generators: takes bytes in,
+    // finds frames in them and decodes one frame at a time into its own PCM
+    // buffer. Nothing is allocated after construction.
+    class PCMFramer {
+    public:
+        enum class Status {
+            kFrame = 0, // a frame was decoded into pcm
+            kNeedInput, // no complete frame is buffered
+            kEnd,       // finish() was called and everything buffered is used up
+        };
+
+        static const size_t kInputBufferSize = 16384; // room for several of the largest frames
+
+        MP3FrameDecoder decoder;
+        int16_t pcm[2304];
+        uint32_t channels = 0;
+        uint32_t sample_rate = 0;
+        uint64_t position = 0;  // of the current frame, in samples per channel
+
+        // where the next input bytes go and how many fit
+        uint8_t* space(size_t* size);
+        void commit(size_t size);
+        void finish() { eof = true; }
+
+        Status decodeNext();
+        // the current frame as blocks (one, or one per granule)
+        uint32_t numBlocks(PCMGranularity granularity) { return granularity == PCMGranularity::kGranule ? 2 : 1; }
+        PCMBlock block(PCMGranularity granularity, uint32_t index);
+
+    private:
+        uint8_t input[kInputBufferSize];
+        size_t begin = 0;
+        size_t end = 0;
+        uint64_t samples_decoded = 0;
+        bool synced = false; // begin is at a frame boundary we trust
+        bool eof = false;
+    };
+
+    // the coroutine frame holds a decoder with 64 byte aligned members
+    struct AlignedCoroutineFrame {
+        static void* operator new(size_t size) { return ::operator new(size, std::align_val_t(64)); }
+        static void operator delete(void* ptr, size_t size) { ::operator delete(ptr, size, std::align_val_t(64)); }
+    };
+
+    // Lazily decodes frames as the consumer asks for blocks:
+    //
+    //     PCMGenerator pcm = decodePCM(source);
+    //     while (pcm.next()) use(pcm.block());
+    //     if (pcm.needsInput()) ... push more into the source, call next() again
+    //
+    // next() returns false both when the source has nothing available right
+    // now (needsInput()) and at the end of the stream (done()).
+    class PCMGenerator {
+    public:
+        struct promise_type : AlignedCoroutineFrame {
+            const PCMBlock* current = nullptr;
+            std::exception_ptr exception;
+
+            PCMGenerator get_return_object() {
+                return PCMGenerator(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            // nullptr means the source ran dry
+            std::suspend_always yield_value(const PCMBlock* block) noexcept {
+                current = block;
+                return {};
+            }
+            void return_void() { current = nullptr; }
+            void unhandled_exception() { exception = std::current_exception(); }
+        };
+
+        PCMGenerator(PCMGenerator&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        PCMGenerator& operator=(PCMGenerator&& other) noexcept {
+            if (this != &other) {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+        ~PCMGenerator() {
+            if (handle) handle.destroy();
+        }
+
+        bool next();
+        const PCMBlock& block() { return *handle.promise().current; }
+        bool done() { return !handle || handle.done(); }
+        bool needsInput() { return !done() && !handle.promise().current; }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit PCMGenerator(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    };
+
+    PCMGenerator decodePCM(ByteSource& source, PCMGranularity granularity = PCMGranularity::kFrame);
+
+    // Async counterpart of PCMGenerator, pulled with co_await:
+    //
+    //     AsyncPCMStream pcm = decodePCMAsync(socket);
+    //     while (const PCMBlock* block = co_await pcm.next()) use(*block);
+    //
+    // The producer runs on the consumer's stack until it awaits input; when
+    // the source resumes it, it runs on until it has a block and then
+    // resumes the consumer.
+    class AsyncPCMStream {
+    public:
+        struct promise_type : AlignedCoroutineFrame {
+            const PCMBlock* current = nullptr;
+            std::coroutine_handle<> consumer;
+            std::exception_ptr exception;
+
+            // hands control back to whoever is waiting in next()
+            struct ToConsumer {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    return handle.promise().consumer;
+                }
+                void await_resume() noexcept {}
+            };
+
+            AsyncPCMStream get_return_object() {
+                return AsyncPCMStream(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            ToConsumer final_suspend() noexcept { return {}; }
+            ToConsumer yield_value(const PCMBlock* block) noexcept {
+                current = block;
+                return {};
+            }
+            void return_void() { current = nullptr; }
+            void unhandled_exception() {
+                current = nullptr;
+                exception = std::current_exception();
+            }
+        };
+
+        struct NextAwaiter {
+            std::coroutine_handle<promise_type> handle;
+
+            bool await_ready() { return !handle || handle.done(); }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> consumer) {
+                handle.promise().consumer = consumer;
+                return handle;
+            }
+            // nullptr at the end of the stream
+            const PCMBlock* await_resume() {
+                if (!handle || handle.done()) {
+                    if (handle && handle.promise().exception) std::rethrow_exception(handle.promise().exception);
+                    return nullptr;
+                }
+                return handle.promise().current;
+            }
+        };
+
+        AsyncPCMStream(AsyncPCMStream&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+        AsyncPCMStream& operator=(AsyncPCMStream&& other) noexcept {
+            if (this != &other) {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+        ~AsyncPCMStream() {
+            if (handle) handle.destroy();
+        }
+
+        NextAwaiter next() { return NextAwaiter{handle}; }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit AsyncPCMStream(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    };
+
+    // Source is anything with a read(uint8_t* out, size_t size) returning an
+    // awaitable that produces the number of bytes read, 0 at the end of input.
+    template<typename Source>
+    AsyncPCMStream decodePCMAsync(Source& source, PCMGranularity granularity = PCMGranularity::kFrame) {
+        PCMFramer framer;
+        while (true) {
+            PCMFramer::Status status = framer.decodeNext();
+            if (status == PCMFramer::Status::kEnd) co_return;
+            if (status == PCMFramer::Status::kNeedInput) {
+                size_t size;
+                uint8_t* space = framer.space(&size);
+                size_t read = co_await source.read(space, size);
+                if (read == 0) {
+                    framer.finish();
+                } else {
+                    framer.commit(read);
+                }
+                continue;
+            }
+            for (uint32_t i = 0; i < framer.numBlocks(granularity); i++) {
+                PCMBlock block = framer.block(granularity, i);
+                co_yield &block;
+            }
+        }
+    }
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_PCM_STREAM_H_
@@ -0,0 +1,303 @@
+#include "probe.h"
+#include "sync.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // how far past the ID3v2 tags we look for the first frame
+    static const size_t kProbeWindow = 16384;
+    // an APE footer (32 bytes) followed by an ID3v1 tag (128 bytes)
+    static const size_t kTailWindow = 160;
+
+    static uint32_t readBE32(const uint8_t* p) {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+    }
+
+    static uint32_t readBE16(const uint8_t* p) {
+        return (uint32_t)p[0] << 8 | p[1];
+    }
+
+    static uint32_t readLE32(const uint8_t* p) {
+        return (uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0];
+    }
+
+    uint32_t id3v2Size(const uint8_t* data, size_t size) {
+        uint32_t total = 0;
+        // some taggers write more than one tag back to back
+        while (total + sizeof(ID3) <= size) {
+            ID3 tag;
+            memcpy(&tag, data + total, sizeof(ID3));
+            if (!tag.isID3()) break;
+            total += tag.tagSize();
+        }
+        return total;
+    }
+
+    uint32_t trailingTagSize(const uint8_t* data, size_t size, MP3Info* info) {
+        const uint8_t* end = data + size;
+        uint32_t total = 0;
+        info->has_id3v1 = false;
+        info->has_ape = false;
+
+        if (size >= 128 && memcmp(end - 128, "TAG", 3) == 0) {
+            info->has_id3v1 = true;
+            total += 128;
+            end -= 128;
+            size -= 128;
+        }
+
+        // the APE footer holds the tag size (items + footer) and whether a
+        // 32 byte header precedes the items
+        if (size >= 32 && memcmp(end - 32, "APETAGEX", 8) == 0) {
+            info->has_ape = true;
+            total += readLE32(end - 32 + 12);
+            if (readLE32(end - 32 + 20) & 0x80000000) {
+                total += 32;
+            }
+        }
+        return total;
+    }
+
+    // converts the VBRI table (byte sizes of groups of frames) to a Xing style TOC
+    static void vbriToToc(const uint8_t* table, uint32_t entries, uint32_t entry_size,
+                          uint32_t scale, uint32_t frames_per_entry, MP3Info* info) {
+        uint64_t position = 0;
+        uint32_t entry = 0;
+        for (int i = 0; i < 100; i++) {
+            uint32_t target = (uint32_t)((uint64_t)info->num_frames * i / 100) / frames_per_entry;
+            while (entry < target && entry < entries) {
+                uint32_t value = 0;
+                for (uint32_t b = 0; b < entry_size; b++) {
+                    value = value << 8 | table[entry * entry_size + b];
+                }
+                position += (uint64_t)value * scale;
+                entry++;
+            }
+            uint64_t toc = info->num_bytes ? position * 256 / info->num_bytes : 0;
+            info->toc[i] = (uint8_t)min<uint64_t>(toc, 255);
+        }
+    }
+
+    // looks for a Xing/Info or VBRI header (plus the LAME extension) in the
+    // frame at data; size is the number of bytes available from data
+    static void parseVBRHeader(const uint8_t* data, size_t size, MP3FrameHeader header, MP3Info* info) {
+        // Xing/Info directly follows the side info (writers never add a CRC to it)
+        size_t xing = 4 + header.sideInfoSize();
+        if (xing + 8 <= size && (memcmp(data + xing, "Xing", 4) == 0 || memcmp(data + xing, "Info", 4) == 0)) {
+            info->vbr_header = data[xing] == 'X' ? VBRHeader::kXing : VBRHeader::kInfo;
+            uint32_t flags = readBE32(data + xing + 4);
+            size_t field = xing + 8;
+            if ((flags & 0x1) && field + 4 <= size) {
+                info->num_frames = readBE32(data + field);
+                info->is_estimate = false;
+                field += 4;
+            }
+            if ((flags & 0x2) && field + 4 <= size) {
+                info->num_bytes = readBE32(data + field);
+                field += 4;
+            }
+            if ((flags & 0x4) && field + 100 <= size) {
+                info->has_toc = true;
+                memcpy(info->toc, data + field, 100);
+                field += 100;
+            }
+            if (flags & 0x8) {
+                // quality indicator
+                field += 4;
+            }
+
+            // LAME extension: 9 byte version string, ..., 12 bit delay, 12 bit padding
+            if (field + 24 <= size && (memcmp(data + field, "LAME", 4) == 0
+                    || memcmp(data + field, "Lavf", 4) == 0 || memcmp(data + field, "Lavc", 4) == 0)) {
+                info->has_lame = true;
+                memcpy(info->encoder, data + field, 9);
+                info->encoder[9] = '\0';
+                info->encoder_delay = data[field + 21] << 4 | data[field + 22] >> 4;
+                info->encoder_padding = (data[field + 22] & 0x0F) << 8 | data[field + 23];
+            }
+            return;
+        }
+
+        // VBRI always sits 32 bytes after the header
+        size_t vbri = 4 + 32;
+        if (vbri + 26 <= size && memcmp(data + vbri, "VBRI", 4) == 0) {
+            info->vbr_header = VBRHeader::kVBRI;
+            info->encoder_delay = readBE16(data + vbri + 6);
+            info->num_bytes = readBE32(data + vbri + 10);
+            info->num_frames = readBE32(data + vbri + 14);
+            info->is_estimate = false;
+
+            uint32_t entries = readBE16(data + vbri + 18);
+            uint32_t scale = readBE16(data + vbri + 20);
+            uint32_t entry_size = readBE16(data + vbri + 22);
+            uint32_t frames_per_entry = readBE16(data + vbri + 24);
+            if (entries && entry_size >= 1 && entry_size <= 4 && frames_per_entry
+                && vbri + 26 + (size_t)entries * entry_size <= size) {
+                info->has_toc = true;
+                vbriToToc(data + vbri + 26, entries, entry_size, scale, frames_per_entry, info);
+            }
+        }
+    }
+
+    // everything after the tags have been located: head is the start of the
+    // audio (file offset head_offset), audio_end is where the trailing tags begin
+    static bool probeFrames(const uint8_t* head, size_t head_size, uint64_t head_offset,
+                            uint64_t audio_end, MP3Info* info) {
+        // a chain that is cut off by the probe window still counts
+        size_t first;
+        bool eof = head_offset + head_size >= audio_end;
+        if (findFrame(head, head_size, &first, kDefaultChainLength, eof) == SyncResult::kNotFound) return false;
+
+        MP3FrameHeader header = loadHeader(head + first);
+        info->first_frame = head_offset + first;
+        info->audio_end = audio_end;
+        info->version = header.getVersionId();
+        info->layer = header.getLayerDesc();
+        info->sampling_rate = header.getSamplingRate();
+        info->channels = header.channel_mode == 3 ? 1 : 2;
+        info->samples_per_frame = header.samplesPerFrame();
+
+        info->vbr_header = VBRHeader::kNone;
+        info->is_estimate = true;
+        info->num_frames = 0;
+        info->num_bytes = 0;
+        info->has_lame = false;
+        info->encoder[0] = '\0';
+        info->encoder_delay = 0;
+        info->encoder_padding = 0;
+        info->has_toc = false;
+
+        parseVBRHeader(head + first, head_size - first, header, info);
+
+        // the VBR header frame decodes to silence and is not counted
+        info->audio_start = info->first_frame;
+        if (info->vbr_header != VBRHeader::kNone) {
+            info->audio_start += header.frameLength();
+        }
+        if (info->audio_start > audio_end) return false;
+
+        if (info->num_bytes == 0 || info->num_bytes > audio_end - info->audio_start) {
+            info->num_bytes = audio_end - info->audio_start;
+        }
+        if (info->is_estimate) {
+            // CBR: bytes / (bytes per frame at the first frame's bitrate)
+            uint64_t bits_per_frame = (uint64_t)header.getBitrate() * info->samples_per_frame;
+            info->num_frames = (uint32_t)(info->num_bytes * 8 * info->sampling_rate / bits_per_frame);
+        }
+
+        uint64_t total = (uint64_t)info->num_frames * info->samples_per_frame;
+        uint64_t trimmed = info->encoder_delay + info->encoder_padding;
+        info->num_samples = total > trimmed ? total - trimmed : 0;
+        info->duration = (double)info->num_samples / info->sampling_rate;
+        info->average_bitrate = total ? (uint32_t)(info->num_bytes * 8 * info->sampling_rate / total) : 0;
+        return true;
+    }
+
+    bool probe(const uint8_t* data, size_t size, MP3Info* info) {
+        info->id3v2_size = id3v2Size(data, size);
+        size_t tail = min(size, kTailWindow);
+        info->trailing_tag_size = trailingTagSize(data + size - tail, tail, info);
+        if ((uint64_t)info->id3v2_size + info->trailing_tag_size >= size) return false;
+
+        uint64_t audio_end = size - info->trailing_tag_size;
+        size_t head_size = min<size_t>(audio_end - info->id3v2_size, kProbeWindow);
+        return probeFrames(data + info->id3v2_size, head_size, info->id3v2_size, audio_end, info);
+    }
+
+    static bool readAt(int fd, uint8_t* buffer, size_t size, uint64_t offset) {
+        while (size > 0) {
+            ssize_t ret = pread(fd, buffer, size, offset);
+            if (ret <= 0) return false;
+            buffer += ret;
+            size -= ret;
+            offset += ret;
+        }
+        return true;
+    }
+
+    bool probeFile(const char* path, MP3Info* info) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+
+        bool ok = false;
+        struct stat st;
+        uint8_t head[kProbeWindow];
+        uint8_t tail[kTailWindow];
+        do {
+            if (fstat(fd, &st) != 0) break;
+            uint64_t size = st.st_size;
+
+            // hop over the ID3v2 tags one header at a time without reading them
+            uint64_t offset = 0;
+            ID3 tag;
+            while (offset + sizeof(ID3) <= size && readAt(fd, (uint8_t*)&tag, sizeof(ID3), offset) && tag.isID3()) {
+                offset += tag.tagSize();
+            }
+            info->id3v2_size = (uint32_t)offset;
+
+            size_t tail_size = min<uint64_t>(size, kTailWindow);
+            if (!readAt(fd, tail, tail_size, size - tail_size)) break;
+            info->trailing_tag_size = trailingTagSize(tail, tail_size, info);
+            if (offset + info->trailing_tag_size >= size) break;
+
+            uint64_t audio_end = size - info->trailing_tag_size;
+            size_t head_size = min<uint64_t>(audio_end - offset, kProbeWindow);
+            if (!readAt(fd, head, head_size, offset)) break;
+            ok = probeFrames(head, head_size, offset, audio_end, info);
+        } while (false);
+
+        close(fd);
+        return ok;
+    }
+
+    uint64_t MP3Info::seekOffset(double fraction) {
+        if (fraction < 0) fraction = 0;
+        if (fraction > 1) fraction = 1;
+        if (!has_toc) {
+            return audio_start + (uint64_t)(fraction * num_bytes);
+        }
+
+        // interpolate between the two TOC entries around fraction
+        double percent = fraction * 100;
+        int i = min((int)percent, 99);
+        double a = toc[i];
+        double b = i < 99 ? toc[i + 1] : 256.0;
+        double point = a + (b - a) * (percent - i);
+        return audio_start + (uint64_t)(point / 256.0 * num_bytes);
+    }
+
+    void MP3Info::printInfo() {
+        static const char* vbr_names[] = {"none", "Xing", "Info", "VBRI"};
+        printf("************ MP3 INFO ************\n");
+        printf("\tid3v2_size: %u\n", id3v2_size);
+        printf("\ttrailing_tag_size: %u (id3v1: %d, ape: %d)\n", trailing_tag_size, has_id3v1, has_ape);
+        printf("\tfirst_frame: %llu\n", (unsigned long long)first_frame);
+        printf("\taudio: [%llu, %llu)\n", (unsigned long long)audio_start, (unsigned long long)audio_end);
+        printf("\tsampling_rate: %u\n", sampling_rate);
+        printf("\tchannels: %u\n", channels);
+        printf("\tvbr_header: %s\n", vbr_names[(int)vbr_header]);
+        printf("\tis_estimate: %d\n", is_estimate);
+        printf("\tnum_frames: %u\n", num_frames);
+        printf("\tnum_bytes: %llu\n", (unsigned long long)num_bytes);
+        printf("\tnum_samples: %llu\n", (unsigned long long)num_samples);
+        printf("\tduration: %.3f\n", duration);
+        printf("\taverage_bitrate: %u\n", average_bitrate);
+        if (has_lame) {
+            printf("\tencoder: %s, delay: %u, padding: %u\n", encoder, encoder_delay, encoder_padding);
+        }
+        printf("\thas_toc: %d\n", has_toc);
+    }
+
+}
+
+}
+
+}
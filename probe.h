@@ -0,0 +1,89 @@
+#ifndef INCLUDE_KERNEL_IO_PROBE_H_
+#define INCLUDE_KERNEL_IO_PROBE_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include "mp3.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // which header (if any) the first frame of the stream carries
+    enum class VBRHeader {
+        kNone = 0,
+        kXing,  // "Xing", written by VBR encoders
+        kInfo,  // "Info", same layout as Xing but written for CBR streams
+        kVBRI,  // Fraunhofer
+    };
+
+    // everything we can learn about a stream without decoding audio
+    struct MP3Info {
+        // byte range of the audio frames, tags and the VBR header frame excluded
+        uint64_t audio_start;
+        uint64_t audio_end;
+        uint64_t first_frame; // offset of the first frame (the VBR header frame if there is one)
+
+        // tags
+        uint32_t id3v2_size;
+        uint32_t trailing_tag_size; // ID3v1 and APE together
+        bool has_id3v1;
+        bool has_ape;
+
+        // from the first frame header
+        MPEGAudioVersionId version;
+        LayerDesc layer;
+        uint32_t sampling_rate;
+        uint32_t channels;
+        uint32_t samples_per_frame;
+
+        // stream summary; if is_estimate, no VBR header gave us the frame
+        // count and the numbers assume every frame has the first frame's bitrate
+        VBRHeader vbr_header;
+        bool is_estimate;
+        uint32_t num_frames;
+        uint64_t num_bytes;
+        uint64_t num_samples; // per channel, with encoder delay and padding removed
+        double duration; // seconds
+        uint32_t average_bitrate; // bits per second
+
+        // LAME extension of the Xing/Info header
+        bool has_lame;
+        char encoder[10]; // e.g. "LAME3.100", null terminated
+        uint32_t encoder_delay;
+        uint32_t encoder_padding;
+
+        // seek table: toc[i] * num_bytes / 256 is the byte offset (from
+        // audio_start) of the point i% of the way through the stream
+        bool has_toc;
+        uint8_t toc[100];
+
+        // byte offset of a point in [0, 1] through the stream, from the TOC if
+        // we have one, linear otherwise
+        uint64_t seekOffset(double fraction);
+
+        void printInfo();
+    };
+
+    // total size of the ID3v2 tags at the start of data, 0 if there are none
+    uint32_t id3v2Size(const uint8_t* data, size_t size);
+
+    // data/size is the end of the stream (at least the last 160 bytes if
+    // available); returns the size of the ID3v1 and APE tags found there
+    uint32_t trailingTagSize(const uint8_t* data, size_t size, MP3Info* info);
+
+    // probe a stream that is fully in memory (e.g. mmapped)
+    bool probe(const uint8_t* data, size_t size, MP3Info* info);
+
+    // probe a file using a handful of small reads at its head and tail
+    bool probeFile(const char* path, MP3Info* info);
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_PROBE_H_
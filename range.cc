@@ -0,0 +1,164 @@
+#include "range.h"
+#include "mp3.h"
+#include "probe.h"
+#include "sidecar.h"
+#include "splice.h"
+#include "sync.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    uint64_t FrameIndex::numFrames() const {
+        return sidecar ? sidecar->numFrames() : offsets.size();
+    }
+
+    uint64_t FrameIndex::frameOffset(uint64_t frame) const {
+        return sidecar ? sidecar->frameOffset(frame) : offsets[frame];
+    }
+
+    uint64_t FrameIndex::numSamples() const {
+        uint64_t total = numFrames() * (uint64_t)samples_per_frame;
+        uint64_t trimmed = (uint64_t)encoder_delay + encoder_padding;
+        return total > trimmed ? total - trimmed : 0;
+    }
+
+    bool FrameIndex::outputRange(uint64_t start, uint64_t end, uint64_t* from, uint64_t* to) const {
+        // no output sample lies past total, so clamping there first keeps
+        // the additions below from wrapping for huge ("to the end") values
+        uint64_t total = numFrames() * (uint64_t)samples_per_frame;
+        if (complete) end = min(end, numSamples());
+        start = min(start, total);
+        end = min(end, total);
+        uint64_t lead = (uint64_t)encoder_delay + kDecoderDelay;
+        *from = start + lead;
+        *to = min(end + lead, total);
+        return start < end && *from < *to;
+    }
+
+    bool buildFrameIndex(const uint8_t* data, size_t size, FrameIndex* index, uint64_t max_frames,
+                         MP3Info* probed) {
+        MP3Info local;
+        MP3Info& info = probed ? *probed : local;
+        index->offsets.clear();
+        index->sidecar = nullptr;
+        index->complete = false;
+        if (!probe(data, size, &info)) return false;
+        if (info.version != MPEGAudioVersionId::kVersion1 || info.layer != LayerDesc::kLayer3) return false;
+        index->samples_per_frame = info.samples_per_frame;
+        index->sampling_rate = info.sampling_rate;
+        index->encoder_delay = info.encoder_delay;
+        index->encoder_padding = info.encoder_padding;
+
+        MP3FrameHeader first = loadHeader(data + info.first_frame);
+        size_t offset = info.audio_start;
+        while (offset + 4 <= info.audio_end) {
+            if (index->offsets.size() == max_frames) return true;
+            const uint8_t* frame = data + offset;
+            MP3FrameHeader header = loadHeader(frame);
+            if (!header.isValid() || !sameStream(first, header)) {
+                size_t skip;
+                SyncResult sync = findFrame(frame, info.audio_end - offset, &skip, kDefaultChainLength, true);
+                if (sync != SyncResult::kFound) break;
+                offset += skip ? skip : 1;
+                continue;
+            }
+            uint32_t frame_size = header.frameLength();
+            if (offset + frame_size > info.audio_end) break;
+            index->offsets.push_back(offset);
+            offset += frame_size;
+        }
+        index->complete = true;
+        return !index->offsets.empty();
+    }
+
+    void prerollTo(MP3FrameDecoder* decoder, const uint8_t* data, const FrameIndex& index, uint64_t frame,
+                   RangeResult* result) {
+        if (frame == 0) return;
+
+        // one frame of pre-roll, and before it the frames main_data_begin
+        // of the pre-roll frame reaches into
+        uint64_t begin = frame - 1;
+        uint64_t prime = begin;
+        const uint8_t* head = data + index.frameOffset(begin);
+        MP3FrameHeader header = loadHeader(head);
+        const uint8_t* side_info = head + 4 + (header.protection_bit ? 0 : 2);
+        int64_t needed = side_info[0] << 1 | side_info[1] >> 7;
+        while (needed > 0 && prime > 0) {
+            prime--;
+            needed -= loadHeader(data + index.frameOffset(prime)).mainDataSize();
+        }
+
+        for (uint64_t i = prime; i < begin; i++) {
+            uint8_t* bytes = (uint8_t*)data + index.frameOffset(i);
+            decoder->getHeader(bytes);
+            decoder->setSideInfo(bytes + 4 + (decoder->header->protection_bit ? 0 : 2));
+            decoder->loadMainData(bytes);
+            result->frames_primed++;
+        }
+
+        int16_t pcm[2304];
+        uint8_t* bytes = (uint8_t*)data + index.frameOffset(begin);
+        decoder->getHeader(bytes);
+        decoder->decodeFrame(bytes, pcm);
+        result->frames_decoded++;
+    }
+
+    RangeResult decodeRange(const uint8_t* data, size_t size, uint64_t start, uint64_t end,
+                            std::vector<int16_t>* out, const FrameIndex* index) {
+        RangeResult result = {RangeStatus::kOk, 0, 0, 0};
+        out->clear();
+
+        FrameIndex scanned;
+        if (!index) {
+            // enough frames for the range under the largest possible delay,
+            // or all of them if end is too large to add that to
+            uint64_t max_frames = UINT64_MAX;
+            if (end <= UINT64_MAX - 4095 - kDecoderDelay) max_frames = (end + 4095 + kDecoderDelay) / 1152 + 2;
+            if (!buildFrameIndex(data, size, &scanned, max_frames)) {
+                result.status = RangeStatus::kNotMP3;
+                return result;
+            }
+            index = &scanned;
+        }
+
+        uint64_t spf = index->samples_per_frame;
+        uint64_t first_sample, end_sample;
+        if (!index->outputRange(start, end, &first_sample, &end_sample)) {
+            result.status = RangeStatus::kEmptyRange;
+            return result;
+        }
+        uint64_t first = first_sample / spf;
+        uint64_t last = (end_sample - 1) / spf;
+
+        MP3FrameDecoder* decoder = new MP3FrameDecoder();
+        prerollTo(decoder, data, *index, first, &result);
+
+        out->resize((end_sample - first_sample) * 2);
+        int16_t pcm[2304];
+        for (uint64_t i = first; i <= last; i++) {
+            uint8_t* frame = (uint8_t*)data + index->frameOffset(i);
+            decoder->getHeader(frame);
+            decoder->decodeFrame(frame, pcm);
+            result.frames_decoded++;
+
+            // the part of this frame's samples inside the range
+            uint64_t frame_start = i * spf;
+            uint64_t from = max(first_sample, frame_start);
+            uint64_t to = min(end_sample, frame_start + spf);
+            memcpy(out->data() + (from - first_sample) * 2, pcm + (from - frame_start) * 2,
+                   (to - from) * 2 * sizeof(int16_t));
+        }
+        delete decoder;
+
+        result.samples = end_sample - first_sample;
+        return result;
+    }
+
+}
+
+}
+
+}
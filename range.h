@@ -0,0 +1,86 @@
+#ifndef INCLUDE_KERNEL_IO_RANGE_H_
+#define INCLUDE_KERNEL_IO_RANGE_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    class SidecarIndex;
+    struct MP3Info;
+
+    // where each audio frame of an MPEG-1 layer III stream starts. Frame i
+    // decodes to output samples [i, i + 1) * samples_per_frame, which hold
+    // stream sample s at s + encoder_delay + kDecoderDelay (as in splice.h,
+    // samples are counted per channel after the encoder delay)
+    struct FrameIndex {
+        std::vector<uint64_t> offsets; // byte offset of each frame in the file
+        const SidecarIndex* sidecar = nullptr; // if set, offsets are read from it instead (and left empty)
+        uint32_t samples_per_frame;
+        uint32_t sampling_rate;
+        uint32_t encoder_delay;        // from the LAME tag, 0 without one
+        uint32_t encoder_padding;
+        bool complete;                 // false if the scan stopped at max_frames
+
+        uint64_t numFrames() const;
+        uint64_t frameOffset(uint64_t frame) const;
+        // stream samples per channel the indexed frames cover
+        uint64_t numSamples() const;
+        // stream samples [start, end) as output samples [*from, *to) of a
+        // decode from the first frame, end clamped to the stream (if the
+        // index is complete) and to the indexed frames; false if empty
+        bool outputRange(uint64_t start, uint64_t end, uint64_t* from, uint64_t* to) const;
+    };
+
+    // Walks the frame headers of the file data/size (tags included) and
+    // records up to max_frames frame offsets, resyncing past garbage the way
+    // decodeFrames does; false if no MPEG-1 layer III frames are found.
+    // info, if given, gets what probe() found (tags, LAME header).
+    bool buildFrameIndex(const uint8_t* data, size_t size, FrameIndex* index, uint64_t max_frames = UINT64_MAX,
+                         MP3Info* info = nullptr);
+
+    enum class RangeStatus {
+        kOk = 0,
+        kNotMP3,     // no MPEG-1 layer III frames found
+        kEmptyRange, // start is at or past the end of the stream, or start >= end
+    };
+
+    struct RangeResult {
+        RangeStatus status;
+        uint64_t samples;        // per channel written to out, after clamping end to the stream
+        uint32_t frames_primed;  // run through the bit reservoir only
+        uint32_t frames_decoded; // pre-roll included
+    };
+
+    struct MP3FrameDecoder;
+
+    // readies a freshly constructed decoder to decode frame of index as a
+    // decode from the first frame would have it (the pre-roll and reservoir
+    // priming decodeRange does); adds the frames it used to result
+    void prerollTo(MP3FrameDecoder* decoder, const uint8_t* data, const FrameIndex& index, uint64_t frame,
+                   RangeResult* result);
+
+    // Decodes samples [start, end) per channel of the file data/size into
+    // out (interleaved stereo, resized to fit), bit-identical to the same
+    // samples of a decode from the first frame. Only the frames that hold
+    // the range are decoded, after one frame of pre-roll (which leaves the
+    // IMDCT overlap and synthesis FIFO as a full decode would) and the few
+    // frames before that whose main data its main_data_begin reaches into,
+    // which only go through the bit reservoir. With an index the cost is
+    // proportional to the range; without one, headers are walked from the
+    // start of the file up to the end of the range.
+    RangeResult decodeRange(const uint8_t* data, size_t size, uint64_t start, uint64_t end,
+                            std::vector<int16_t>* out, const FrameIndex* index = nullptr);
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_RANGE_H_
@@ -0,0 +1,142 @@
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "audio_util.h"
+#include "math.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    static uint32_t gcd(uint32_t a, uint32_t b) {
+        while (b) {
+            uint32_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // taps is a multiple of 8
+    static inline float dot(const float* a, const float* b, uint32_t taps) {
+#if defined(__AVX2__)
+        __m256 sum = _mm256_setzero_ps();
+        for (uint32_t i = 0; i < taps; i += 8)
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+        return _mm_cvtss_f32(half);
+#elif defined(__SSE2__)
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        for (uint32_t i = 0; i < taps; i += 8) {
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        __m128 sum = _mm_add_ps(sum0, sum1);
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+        return _mm_cvtss_f32(sum);
+#else
+        float sum = 0;
+        for (uint32_t i = 0; i < taps; i++)
+            sum += a[i] * b[i];
+        return sum;
+#endif
+    }
+
+    static inline int16_t toPCM(float sample) {
+        float f = sample * 32768;
+        if (f > 32767) f = 32767;
+        if (f < -32768) f = -32768;
+        return (int16_t)f;
+    }
+
+    Resampler::Resampler(uint32_t in_rate, uint32_t out_rate, uint32_t taps)
+        : in_rate(in_rate), out_rate(out_rate) {
+        uint32_t divisor = gcd(in_rate, out_rate);
+        up = out_rate / divisor;
+        down = in_rate / divisor;
+        // the cutoff falls with out_rate when downsampling, so the filter
+        // has to span as many more input samples to keep it as sharp
+        if (down > up) taps = (uint32_t)(((uint64_t)taps * down + up - 1) / up);
+        this->taps = taps = max<uint32_t>(8, (taps + 7) & ~7u);
+
+        // windowed sinc at the upsampled rate, cut off a little below the
+        // lower of the two Nyquist frequencies
+        uint32_t length = up * taps;
+        double cutoff = 0.45 / max(up, down);
+        double center = (length - 1) / 2.0;
+        std::vector<double> prototype(length);
+        for (uint32_t n = 0; n < length; n++) {
+            double x = n - center;
+            double sinc = x == 0 ? 2 * cutoff
+                                 : std::sin(2 * util::math::M_PI * cutoff * x) / (util::math::M_PI * x);
+            double t = 2 * util::math::M_PI * n / (length - 1);
+            double window = 0.42 - 0.5 * std::cos(t) + 0.08 * std::cos(2 * t); // Blackman
+            prototype[n] = sinc * window * up;
+        }
+
+        // phase p takes every up-th tap starting at p, newest input last
+        coefs.resize(up * taps);
+        for (uint32_t p = 0; p < up; p++)
+            for (uint32_t j = 0; j < taps; j++)
+                coefs[p * taps + (taps - 1 - j)] = (float)prototype[j * up + p];
+
+        for (int ch = 0; ch < 2; ch++) {
+            work[ch].resize(taps - 1 + kMaxBlock);
+        }
+        reset();
+    }
+
+    void Resampler::reset(uint64_t input_position) {
+        for (int ch = 0; ch < 2; ch++) {
+            std::fill(work[ch].begin(), work[ch].end(), 0.0f);
+        }
+        // first output at or after input_position on the stream's output grid
+        output_position = (input_position * up + down - 1) / down;
+        uint64_t t = output_position * down;
+        pos = (uint32_t)(t / up - input_position);
+        phase = (uint32_t)(t % up);
+    }
+
+    uint32_t Resampler::process(const float* const* in, uint32_t channels, uint32_t length, int16_t* out) {
+        uint32_t history = taps - 1;
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            memcpy(work[ch].data() + history, in[ch], length * sizeof(float));
+        }
+
+        uint32_t count = 0;
+        while (pos < length) {
+            const float* h = &coefs[phase * taps];
+            for (uint32_t ch = 0; ch < channels; ch++) {
+                out[count * channels + ch] = toPCM(dot(h, work[ch].data() + pos, taps));
+            }
+            count++;
+            phase += down;
+            pos += phase / up;
+            phase %= up;
+        }
+        pos -= length;
+
+        // keep the last taps - 1 inputs for the next block
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            memmove(work[ch].data(), work[ch].data() + length, history * sizeof(float));
+        }
+        output_position += count;
+        return count;
+    }
+
+}
+
+}
+
+}
@@ -0,0 +1,67 @@
+#ifndef INCLUDE_KERNEL_IO_RESAMPLER_H_
+#define INCLUDE_KERNEL_IO_RESAMPLER_H_
+
+#include "stdint.h"
+#include <vector>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // Polyphase FIR resampler for a fixed rational ratio out_rate/in_rate,
+    // meant to be attached to an MP3FrameDecoder so each granule is resampled
+    // while the synthesis output is still in cache. Takes float samples in
+    // [-1, 1] one block at a time and writes interleaved int16; filter state
+    // carries across blocks. Everything is allocated by the constructor.
+    class Resampler {
+        uint32_t in_rate;
+        uint32_t out_rate;
+        uint32_t up;    // out_rate / gcd
+        uint32_t down;  // in_rate / gcd
+        uint32_t taps;  // per phase, a multiple of 8
+
+        std::vector<float> coefs;   // up phases of taps coefficients, reversed for a forward dot product
+        std::vector<float> work[2]; // taps - 1 samples of history followed by the current block
+
+        // the next output sample sits at input index pos + phase / up
+        // (relative to the current block)
+        uint32_t phase;
+        uint32_t pos;
+        uint64_t output_position;
+
+    public:
+        static const uint32_t kDefaultTaps = 32;
+        static const uint32_t kMaxBlock = 576;
+
+        // taps is per phase when upsampling; when downsampling it is scaled
+        // by in_rate / out_rate, so the transition band keeps its width
+        // relative to the output rate
+        Resampler(uint32_t in_rate, uint32_t out_rate, uint32_t taps = kDefaultTaps);
+
+        uint32_t inputRate() { return in_rate; }
+        uint32_t outputRate() { return out_rate; }
+        // most samples (per channel) one process() call can write for length inputs
+        uint32_t maxOutput(uint32_t length) { return (uint32_t)(((uint64_t)length * up + down - 1) / down) + 1; }
+        // index (per channel) of the next sample process() will write
+        uint64_t outputPosition() { return output_position; }
+        // group delay of the filter, in input samples
+        uint32_t delay() { return taps / 2; }
+
+        // resamples length (<= kMaxBlock) samples of each of channels (1 or 2)
+        // channels into out, interleaved; returns samples written per channel
+        uint32_t process(const float* const* in, uint32_t channels, uint32_t length, int16_t* out);
+
+        // clears the filter history and lines the output up with the stream
+        // as if input_position samples had gone through; call after seeking
+        void reset(uint64_t input_position = 0);
+    };
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_RESAMPLER_H_
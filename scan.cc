@@ -0,0 +1,194 @@
+#include "scan.h"
+#include <cmath>
+#include "mp3.h"
+#include "sync.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // offsets from the raw estimates to dBFS of the decoded PCM, fitted on
+    // 44.1 kHz music
+    static const double kSideInfoOffsetDB = 60.0;
+    static const double kSpectrumOffsetDB = 24.2;
+    static const float kSilenceFloorDB = -120.0f;
+
+    // global_gain sets the quantizer step (2^(1/4) in amplitude per unit),
+    // big_values how many lines are coded with it; a granule with no bits is
+    // silent
+    static float sideInfoLevel(MP3FrameDecoder* decoder) {
+        MP3SideInfo* side_info = decoder->side_info;
+        uint32_t channels = decoder->header->channels();
+        double power = 0;
+        for (int gr = 0; gr < 2; gr++)
+            for (uint32_t ch = 0; ch < channels; ch++) {
+                if (side_info->granule[gr][ch].part2_3_length == 0) continue;
+                double lines = min<uint32_t>(576, 2 * side_info->granule[gr][ch].big_value + 4);
+                power += lines / 576.0 * std::exp2(0.5 * ((double)side_info->granule[gr][ch].global_gain - 210.0));
+            }
+        if (power <= 0) return kSilenceFloorDB;
+        return (float)(10.0 * std::log10(power / (2 * channels)) + kSideInfoOffsetDB);
+    }
+
+    // Huffman-decodes and requantizes frame index (IMDCT and synthesis are
+    // skipped), priming the bit reservoir from the frames before it
+    static bool spectrumLevel(MP3FrameDecoder* decoder, uint8_t* data, const std::vector<FrameLevel>& frames,
+                              size_t index, float* level) {
+        size_t first = index;
+        uint64_t primed = 0;
+        while (first > 0 && primed < kMaxReservoirSize + 64) {
+            first--;
+            primed = frames[index].offset - frames[first].offset;
+        }
+
+        decoder->reservoir_size = 0;
+        for (size_t i = first; i < index; i++) {
+            uint8_t* frame = data + frames[i].offset;
+            decoder->getHeader(frame);
+            decoder->setSideInfo(frame + 4 + (decoder->header->protection_bit ? 0 : 2));
+            decoder->loadMainData(frame);
+        }
+
+        uint8_t* frame = data + frames[index].offset;
+        decoder->getHeader(frame);
+        decoder->setSideInfo(frame + 4 + (decoder->header->protection_bit ? 0 : 2));
+        if (!decoder->setMainData(frame)) return false;
+
+        // mid/side is orthonormal, so the energy is the same either way
+        uint32_t channels = decoder->header->channels();
+        double energy = 0;
+        for (int gr = 0; gr < 2; gr++)
+            for (uint32_t ch = 0; ch < channels; ch++) {
+                decoder->requantize(gr, ch);
+                for (int i = 0; i < 576; i++)
+                    energy += decoder->samples[gr][ch][i] * decoder->samples[gr][ch][i];
+            }
+        *level = energy > 0 ? (float)(10.0 * std::log10(energy / (2 * channels * 576)) + kSpectrumOffsetDB)
+                            : kSilenceFloorDB;
+        return true;
+    }
+
+    static void findSilences(const ScanConfig& config, ScanResult* result) {
+        double frame_seconds = (double)result->samples_per_frame / result->sample_rate;
+        uint32_t min_frames = max<uint32_t>(1, (uint32_t)(config.min_silence_ms / 1000.0 / frame_seconds));
+        size_t num_frames = result->frames.size();
+        size_t start = 0;
+        for (size_t i = 0; i <= num_frames; i++) {
+            bool silent = i < num_frames && result->frames[i].level_db < config.silence_db;
+            if (silent) continue;
+            if (i - start >= min_frames) {
+                result->silences.push_back(SilenceRun{(uint32_t)start, (uint32_t)(i - start),
+                                                      start * frame_seconds, (i - start) * frame_seconds});
+            }
+            start = i + 1;
+        }
+    }
+
+    // mean level over a window on each side of every frame; a change point
+    // is the largest step within a window that exceeds change_db
+    static void findChanges(const ScanConfig& config, ScanResult* result) {
+        double frame_seconds = (double)result->samples_per_frame / result->sample_rate;
+        size_t window = max<size_t>(1, (size_t)(config.change_window_ms / 1000.0 / frame_seconds));
+        size_t num_frames = result->frames.size();
+        if (num_frames < 2 * window) return;
+
+        // levels below the silence threshold all count as the threshold, so
+        // the depth of a gap does not matter
+        std::vector<double> prefix(num_frames + 1, 0.0);
+        for (size_t i = 0; i < num_frames; i++) {
+            prefix[i + 1] = prefix[i] + max(result->frames[i].level_db, config.silence_db);
+        }
+        std::vector<float> step;
+        step.assign(num_frames, 0.0f);
+        for (size_t i = window; i + window <= num_frames; i++) {
+            double before = (prefix[i] - prefix[i - window]) / window;
+            double after = (prefix[i + window] - prefix[i]) / window;
+            step[i] = (float)(after - before);
+        }
+        for (size_t i = window; i + window <= num_frames; i++) {
+            float size = step[i] < 0 ? -step[i] : step[i];
+            if (size < config.change_db) continue;
+            bool peak = true;
+            for (size_t j = i - window + 1; j < i + window && peak; j++) {
+                if (j == i || j >= num_frames) continue;
+                float other = step[j] < 0 ? -step[j] : step[j];
+                peak = other < size || (other == size && j > i);
+            }
+            if (!peak) continue;
+            float before = (float)((prefix[i] - prefix[i - window]) / window);
+            float after = (float)((prefix[i + window] - prefix[i]) / window);
+            result->changes.push_back(ChangePoint{(uint32_t)i, i * frame_seconds, before, after});
+        }
+    }
+
+    bool scanStream(const uint8_t* input, size_t size, const ScanConfig& config, ScanResult* result) {
+        uint8_t* data = (uint8_t*)input;
+        result->frames.clear();
+        result->silences.clear();
+        result->changes.clear();
+        result->refined_frames = 0;
+
+        MP3FrameDecoder* decoder = new MP3FrameDecoder();
+        MP3FrameHeader first = {};
+        size_t offset = 0;
+        while (offset + 4 <= size) {
+            uint8_t* frame = data + offset;
+            MP3FrameHeader header = loadHeader(frame);
+            if (!header.isDecodable() || (result->frames.size() && !sameStream(first, header))) {
+                size_t skip;
+                SyncResult sync = findFrame(frame, size - offset, &skip, kDefaultChainLength, true);
+                if (sync != SyncResult::kFound) break;
+                offset += skip ? skip : 1;
+                continue;
+            }
+            uint32_t frame_size = header.frameLength();
+            if (offset + frame_size > size) break;
+            if (result->frames.empty()) first = header;
+
+            decoder->getHeader(frame);
+            decoder->bindScratch();
+            decoder->setSideInfo(frame + 4 + (header.protection_bit ? 0 : 2));
+            result->frames.push_back(FrameLevel{offset, sideInfoLevel(decoder), false});
+            offset += frame_size;
+        }
+        if (result->frames.empty()) {
+            delete decoder;
+            return false;
+        }
+        result->sample_rate = first.getSamplingRate();
+        result->samples_per_frame = first.samplesPerFrame();
+
+        if (config.refine) {
+            for (size_t i = 0; i < result->frames.size(); i++) {
+                FrameLevel& frame = result->frames[i];
+                float distance = frame.level_db - config.silence_db;
+                if (distance < 0) distance = -distance;
+                if (distance > config.ambiguity_db) continue;
+                float level;
+                if (spectrumLevel(decoder, data, result->frames, i, &level)) {
+                    frame.level_db = level;
+                    frame.refined = true;
+                    result->refined_frames++;
+                }
+            }
+        }
+        delete decoder;
+
+        // averaged in dB: the side info estimate is too noisy for a power
+        // average, which a few overestimated frames would dominate
+        double sum = 0;
+        for (const FrameLevel& frame : result->frames) sum += frame.level_db;
+        result->mean_level_db = sum / result->frames.size();
+
+        findSilences(config, result);
+        findChanges(config, result);
+        return true;
+    }
+
+}
+
+}
+
+}
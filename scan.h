@@ -0,0 +1,69 @@
+#ifndef INCLUDE_KERNEL_IO_SCAN_H_
+#define INCLUDE_KERNEL_IO_SCAN_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    struct ScanConfig {
+        float silence_db = -55;          // frames estimated below this are silent
+        uint32_t min_silence_ms = 300;   // shorter quiet stretches are not reported
+        uint32_t change_window_ms = 1000; // level averaged over this much on each side
+        float change_db = 6;             // smallest level step reported as a change point
+        // Huffman-decode frames whose side info estimate lies within
+        // ambiguity_db of silence_db (no IMDCT or synthesis)
+        bool refine = false;
+        float ambiguity_db = 10;
+    };
+
+    struct FrameLevel {
+        uint64_t offset;   // of the frame header
+        float level_db;    // estimated mean power, dBFS
+        bool refined;      // level_db comes from the spectrum rather than side info
+    };
+
+    struct SilenceRun {
+        uint32_t first_frame;
+        uint32_t num_frames;
+        double start;      // seconds
+        double duration;
+    };
+
+    struct ChangePoint {
+        uint32_t frame;
+        double time;       // seconds
+        float before_db;   // mean level over the window before
+        float after_db;    // and after
+    };
+
+    struct ScanResult {
+        uint32_t sample_rate;
+        uint32_t samples_per_frame;
+        uint32_t refined_frames;
+        double mean_level_db;     // average of level_db over all frames
+        std::vector<FrameLevel> frames;
+        std::vector<SilenceRun> silences;
+        std::vector<ChangePoint> changes;
+    };
+
+    // Level of every frame of an MP3 stream estimated from its header and
+    // side info alone (global gain and how much of the spectrum is coded),
+    // plus the silence runs and level change points that follow from it.
+    // Good to roughly +-10 dB on music but exact about digital silence;
+    // config.refine brings ambiguous frames to a few dB. data starts at the
+    // first frame; false if no MPEG-1 layer III frame is found.
+    bool scanStream(const uint8_t* data, size_t size, const ScanConfig& config, ScanResult* result);
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_SCAN_H_
@@ -0,0 +1,194 @@
+#include "sidecar.h"
+#include <algorithm>
+#include "audio_util.h"
+#include "splice.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    static uint64_t hashBytes(uint64_t h, const uint8_t* data, size_t size) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, data + i, 8);
+            h = mixWord(h, word);
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, data + i, size - i);
+        return mixWord(h, tail ^ (uint64_t)size << 56);
+    }
+
+    uint64_t sidecarChecksum(const uint8_t* data, size_t size) {
+        return hashBytes(0x6D7033696E646578ull, data, size);
+    }
+
+    uint64_t sidecarEdgeChecksum(const uint8_t* data, size_t size) {
+        size_t edge = min<size_t>(size, kSidecarEdgeBytes);
+        return hashBytes(hashBytes(size, data, edge), data + size - edge, edge);
+    }
+
+    // region sizes, each padded to 8 bytes so the next one stays aligned
+    static size_t checkpointsSize(uint64_t num_frames) {
+        return (num_frames + kSidecarBlockFrames - 1) / kSidecarBlockFrames * sizeof(uint64_t);
+    }
+
+    static size_t framesSize(uint64_t num_frames) {
+        return (num_frames * sizeof(SidecarFrame) + 7) & ~(size_t)7;
+    }
+
+    static uint64_t countOverflow(const FrameIndex& index) {
+        uint64_t count = 0;
+        for (uint64_t i = 0; i < index.numFrames(); i++) {
+            uint64_t checkpoint = index.frameOffset(i - i % kSidecarBlockFrames);
+            if (index.frameOffset(i) - checkpoint >= kSidecarOverflow) count++;
+        }
+        return count;
+    }
+
+    size_t sidecarSize(const FrameIndex& index) {
+        uint64_t num_frames = index.numFrames();
+        return sizeof(SidecarHeader) + checkpointsSize(num_frames) + framesSize(num_frames)
+            + countOverflow(index) * sizeof(SidecarOverflow);
+    }
+
+    size_t writeSidecar(const FrameIndex& index, const uint8_t* data, size_t size, uint8_t* out, size_t out_size) {
+        size_t total = sidecarSize(index);
+        if (out_size < total || index.numFrames() == 0) return 0;
+        memset(out, 0, total);
+
+        uint64_t num_frames = index.numFrames();
+        SidecarHeader* header = (SidecarHeader*)out;
+        MP3FrameHeader first = loadHeader(data + index.frameOffset(0));
+        header->magic = kSidecarMagic;
+        header->version = kSidecarVersion;
+        header->channel_mode = first.channel_mode;
+        header->complete = index.complete;
+        memcpy(header->first_header, data + index.frameOffset(0), 4);
+        header->sampling_rate = index.sampling_rate;
+        header->samples_per_frame = index.samples_per_frame;
+        header->encoder_delay = index.encoder_delay;
+        header->encoder_padding = index.encoder_padding;
+        header->num_frames = num_frames;
+        header->num_overflow = countOverflow(index);
+        header->source_size = size;
+        header->source_checksum = sidecarChecksum(data, size);
+        header->edge_checksum = sidecarEdgeChecksum(data, size);
+        header->checkpoints_offset = sizeof(SidecarHeader);
+        header->frames_offset = header->checkpoints_offset + checkpointsSize(num_frames);
+        header->overflow_offset = header->frames_offset + framesSize(num_frames);
+
+        uint64_t* checkpoints = (uint64_t*)(out + header->checkpoints_offset);
+        SidecarFrame* frames = (SidecarFrame*)(out + header->frames_offset);
+        SidecarOverflow* overflow = (SidecarOverflow*)(out + header->overflow_offset);
+        for (uint64_t i = 0; i < num_frames; i++) {
+            uint64_t offset = index.frameOffset(i);
+            if (i % kSidecarBlockFrames == 0) checkpoints[i / kSidecarBlockFrames] = offset;
+            uint64_t delta = offset - checkpoints[i / kSidecarBlockFrames];
+            if (delta >= kSidecarOverflow) {
+                *overflow++ = {i, offset};
+                delta = kSidecarOverflow;
+            }
+
+            const uint8_t* frame = data + offset;
+            MP3FrameHeader frame_header = loadHeader(frame);
+            const uint8_t* side_info = frame + 4 + (frame_header.protection_bit ? 0 : 2);
+            SidecarFrame& entry = frames[i];
+            entry.delta = delta;
+            entry.main_data_begin = side_info[0] << 1 | side_info[1] >> 7;
+            entry.bitrate_ind = frame_header.bitrate_ind;
+            entry.padding_bit = frame_header.padding_bit;
+            entry.protection_bit = frame_header.protection_bit;
+            entry.mono = frame_header.channel_mode == 3;
+        }
+        return total;
+    }
+
+    bool SidecarIndex::map(const uint8_t* data, size_t size) {
+        header = nullptr;
+        if (size < sizeof(SidecarHeader) || (uintptr_t)data % alignof(SidecarHeader)) return false;
+        const SidecarHeader* candidate = (const SidecarHeader*)data;
+        if (candidate->magic != kSidecarMagic || candidate->version != kSidecarVersion
+            || candidate->num_frames == 0 || candidate->num_frames > size || candidate->num_overflow > size
+            || candidate->samples_per_frame == 0) {
+            return false;
+        }
+        uint64_t num_frames = candidate->num_frames;
+        if (candidate->checkpoints_offset != sizeof(SidecarHeader)
+            || candidate->frames_offset != candidate->checkpoints_offset + checkpointsSize(num_frames)
+            || candidate->overflow_offset != candidate->frames_offset + framesSize(num_frames)
+            || candidate->overflow_offset + candidate->num_overflow * sizeof(SidecarOverflow) > size) {
+            return false;
+        }
+
+        header = candidate;
+        checkpoints = (const uint64_t*)(data + header->checkpoints_offset);
+        frames = (const SidecarFrame*)(data + header->frames_offset);
+        overflow = (const SidecarOverflow*)(data + header->overflow_offset);
+        return true;
+    }
+
+    bool SidecarIndex::quickMatch(const uint8_t* data, size_t size) const {
+        return size == header->source_size && sidecarEdgeChecksum(data, size) == header->edge_checksum;
+    }
+
+    bool SidecarIndex::fullMatch(const uint8_t* data, size_t size) const {
+        return size == header->source_size && sidecarChecksum(data, size) == header->source_checksum;
+    }
+
+    uint64_t SidecarIndex::frameOffset(uint64_t frame) const {
+        uint16_t delta = frames[frame].delta;
+        if (delta != kSidecarOverflow) return checkpoints[frame / kSidecarBlockFrames] + delta;
+        const SidecarOverflow* end = overflow + header->num_overflow;
+        const SidecarOverflow* entry = std::lower_bound(overflow, end, frame,
+            [](const SidecarOverflow& entry, uint64_t frame) { return entry.frame < frame; });
+        return entry != end && entry->frame == frame ? entry->offset : 0;
+    }
+
+    MP3FrameHeader SidecarIndex::frameHeader(uint64_t frame) const {
+        MP3FrameHeader result = loadHeader(header->first_header);
+        const SidecarFrame& entry = frames[frame];
+        result.bitrate_ind = entry.bitrate_ind;
+        result.padding_bit = entry.padding_bit;
+        result.protection_bit = entry.protection_bit;
+        // only mono or not matters for the layout
+        result.channel_mode = entry.mono ? 3 : 0;
+        return result;
+    }
+
+    uint32_t SidecarIndex::mainDataSize(uint64_t frame) const {
+        return frameHeader(frame).mainDataSize();
+    }
+
+    uint64_t SidecarIndex::frameForSample(uint64_t sample) const {
+        return (sample + header->encoder_delay + kDecoderDelay) / header->samples_per_frame;
+    }
+
+    uint64_t SidecarIndex::primeFrame(uint64_t frame) const {
+        if (frame == 0) return 0;
+        uint64_t prime = frame - 1;
+        int64_t needed = frames[prime].main_data_begin;
+        while (needed > 0 && prime > 0) {
+            prime--;
+            needed -= mainDataSize(prime);
+        }
+        return prime;
+    }
+
+    void SidecarIndex::toFrameIndex(FrameIndex* index) const {
+        index->offsets.clear();
+        index->sidecar = this;
+        index->samples_per_frame = header->samples_per_frame;
+        index->sampling_rate = header->sampling_rate;
+        index->encoder_delay = header->encoder_delay;
+        index->encoder_padding = header->encoder_padding;
+        index->complete = header->complete;
+    }
+
+}
+
+}
+
+}
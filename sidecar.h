@@ -0,0 +1,121 @@
+#ifndef INCLUDE_KERNEL_IO_SIDECAR_H_
+#define INCLUDE_KERNEL_IO_SIDECAR_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include "mp3.h"
+#include "range.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    static const uint32_t kSidecarMagic = 0x5833504D; // "MP3X"
+    static const uint16_t kSidecarVersion = 1;
+    // frames per checkpoint; 32 of the largest layer 3 frames (1441 bytes)
+    // stay inside a 16-bit delta
+    static const uint32_t kSidecarBlockFrames = 32;
+    // a delta that did not fit (garbage between frames): the offset is in the overflow table
+    static const uint16_t kSidecarOverflow = 0xFFFF;
+    // bytes at each end of the source that edge_checksum covers
+    static const uint32_t kSidecarEdgeBytes = 4096;
+
+    // Sidecar index file layout, native byte order, every field naturally
+    // aligned so a mapped file is used in place: this header, then
+    //   checkpoints: uint64 byte offset of every kSidecarBlockFrames-th frame
+    //   frames:      SidecarFrame per frame
+    //   overflow:    SidecarOverflow per escaped delta, by frame
+    struct SidecarHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint8_t channel_mode;       // of the first frame, as in MP3FrameHeader
+        uint8_t complete;           // as FrameIndex::complete
+        uint8_t first_header[4];    // the first frame's header bytes, the template for every frame's geometry
+        uint32_t sampling_rate;
+        uint32_t samples_per_frame; // frame i is output samples [i, i + 1) * samples_per_frame
+        uint32_t encoder_delay;
+        uint32_t encoder_padding;
+        uint32_t reserved;
+        uint64_t num_frames;
+        uint64_t num_overflow;
+        uint64_t source_size;
+        uint64_t source_checksum;   // over the whole source file
+        uint64_t edge_checksum;     // over its first and last kSidecarEdgeBytes, for a cheap check at open
+        uint64_t checkpoints_offset;
+        uint64_t frames_offset;
+        uint64_t overflow_offset;
+    };
+
+    // what a frame's header and side info say about its layout
+    struct SidecarFrame {
+        uint16_t delta;                // bytes from the block's checkpoint, or kSidecarOverflow
+        uint16_t main_data_begin : 9;
+        uint16_t bitrate_ind : 4;
+        uint16_t padding_bit : 1;
+        uint16_t protection_bit : 1;
+        uint16_t mono : 1;
+    };
+
+    struct SidecarOverflow {
+        uint64_t frame;
+        uint64_t offset;
+    };
+
+    // 64-bit hash of a source file, as the sidecar records it (not cryptographic)
+    uint64_t sidecarChecksum(const uint8_t* data, size_t size);
+    uint64_t sidecarEdgeChecksum(const uint8_t* data, size_t size);
+
+    // bytes writeSidecar needs for index
+    size_t sidecarSize(const FrameIndex& index);
+    // The sidecar for index, built from the file data/size it indexes; returns
+    // the bytes written or 0 if out_size < sidecarSize()
+    size_t writeSidecar(const FrameIndex& index, const uint8_t* data, size_t size, uint8_t* out, size_t out_size);
+
+    // Read-only view of a sidecar in memory (e.g. mmapped): nothing is
+    // parsed or copied, and every lookup is O(1) except offsets that went
+    // through the overflow table (a binary search of the rare escaped deltas).
+    class SidecarIndex {
+        const SidecarHeader* header = nullptr;
+        const uint64_t* checkpoints = nullptr;
+        const SidecarFrame* frames = nullptr;
+        const SidecarOverflow* overflow = nullptr;
+
+    public:
+        // false if data/size is not a sidecar or is truncated
+        bool map(const uint8_t* data, size_t size);
+        const SidecarHeader* info() const { return header; }
+
+        // cheap staleness check (size and both ends of the file), and the
+        // full one (every byte)
+        bool quickMatch(const uint8_t* data, size_t size) const;
+        bool fullMatch(const uint8_t* data, size_t size) const;
+
+        uint64_t numFrames() const { return header->num_frames; }
+        uint64_t frameOffset(uint64_t frame) const;
+        uint32_t mainDataBegin(uint64_t frame) const { return frames[frame].main_data_begin; }
+        // the frame's header as far as its geometry goes
+        MP3FrameHeader frameHeader(uint64_t frame) const;
+        // bytes of the frame that go into the bit reservoir
+        uint32_t mainDataSize(uint64_t frame) const;
+
+        // the frame whose output holds stream sample (see FrameIndex)
+        uint64_t frameForSample(uint64_t sample) const;
+        // the first frame decodeRange has to run through the reservoir to
+        // decode frame: the pre-roll frame before it, and the frames that
+        // pre-roll frame's main_data_begin reaches back into
+        uint64_t primeFrame(uint64_t frame) const;
+
+        // a FrameIndex for decodeRange and PCMCache that reads offsets
+        // through this view (nothing is copied; it must stay mapped)
+        void toFrameIndex(FrameIndex* index) const;
+    };
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_SIDECAR_H_
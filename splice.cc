@@ -0,0 +1,357 @@
+#include "splice.h"
+#include <cstring>
+#include "mp3.h"
+#include "probe.h"
+#include "range.h"
+#include "sync.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // the Xing part of the Info frame (tag, flags, frame and byte counts,
+    // TOC, quality) and the LAME extension after it, which ends in a CRC of
+    // everything before it in the frame
+    static const uint32_t kXingSize = 120;
+    static const uint32_t kLameSize = 36;
+
+    // CRC-16 of protected frames: polynomial 0x8005, msb first
+    static uint16_t frameCRC(const uint8_t* data, size_t size, uint16_t crc) {
+        for (size_t i = 0; i < size; i++) {
+            crc ^= data[i] << 8;
+            for (int bit = 0; bit < 8; bit++)
+                crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+        }
+        return crc;
+    }
+
+    // CRC-16 of the LAME tag: the same polynomial reflected, lsb first
+    static uint16_t lameCRC(const uint8_t* data, size_t size, uint16_t crc) {
+        for (size_t i = 0; i < size; i++) {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++)
+                crc = (uint16_t)(crc & 1 ? (crc >> 1) ^ 0xA001 : crc >> 1);
+        }
+        return crc;
+    }
+
+    static void writeBE32(uint8_t* p, uint32_t value) {
+        p[0] = value >> 24;
+        p[1] = value >> 16;
+        p[2] = value >> 8;
+        p[3] = value;
+    }
+
+    // bytes of scalefactors and Huffman data (part2_3_length summed over
+    // both granules) in an MPEG-1 frame
+    static uint32_t mainDataLength(const uint8_t* side_info, bool mono) {
+        uint32_t channels = mono ? 1 : 2;
+        // main_data_begin, private bits, scfsi
+        int bit = 9 + (mono ? 5 : 3) + 4 * channels;
+        uint32_t bits = 0;
+        for (int gr = 0; gr < 2; gr++)
+            for (uint32_t ch = 0; ch < channels; ch++) {
+                bits += readBits((uint8_t*)side_info, bit, bit + 12);
+                bit += 59;
+            }
+        return (bits + 7) / 8;
+    }
+
+    struct SourceStream {
+        MP3Info info;
+        MP3FrameHeader first;
+        std::vector<uint64_t> frames; // offsets of the audio frames
+    };
+
+    // the same header walk as buildFrameIndex, keeping the probe result for
+    // the LAME tag and encoder delay
+    static EditStatus indexStream(const EditSegment& segment, SourceStream* source) {
+        FrameIndex index;
+        if (!buildFrameIndex(segment.data, segment.size, &index, UINT64_MAX, &source->info)) {
+            return EditStatus::kNotMP3;
+        }
+        source->first = loadHeader(segment.data + source->info.first_frame);
+        source->frames = std::move(index.offsets);
+        return EditStatus::kOk;
+    }
+
+    // follows a source stream's bit reservoir to pull out each frame's main
+    // data as a contiguous run of bytes
+    struct MainDataReader {
+        uint8_t reservoir[kMaxReservoirSize];
+        uint32_t reservoir_size = 0;
+
+        // copies the main data of the frame at data to out (kMaxMainDataSize
+        // bytes); false if it starts before the data seen so far or runs
+        // past the end of the frame
+        bool read(const uint8_t* data, uint8_t* out, uint32_t* length) {
+            MP3FrameHeader header = loadHeader(data);
+            const uint8_t* side_info = data + 4 + (header.protection_bit ? 0 : 2);
+            const uint8_t* slot = side_info + header.sideInfoSize();
+            uint32_t slot_size = header.frameLength() - (uint32_t)(slot - data);
+            uint32_t begin = side_info[0] << 1 | side_info[1] >> 7;
+            *length = mainDataLength(side_info, header.channel_mode == 3);
+
+            bool ok = begin <= reservoir_size && *length <= begin + slot_size;
+            if (ok) {
+                memcpy(out, reservoir + reservoir_size - begin, min(begin, *length));
+                if (*length > begin) memcpy(out + begin, slot, *length - begin);
+            }
+
+            // keep the tail of the main data areas for the next frame
+            if (slot_size >= kMaxReservoirSize) {
+                memcpy(reservoir, slot + slot_size - kMaxReservoirSize, kMaxReservoirSize);
+                reservoir_size = kMaxReservoirSize;
+            } else {
+                uint32_t keep = min(reservoir_size, kMaxReservoirSize - slot_size);
+                memmove(reservoir, reservoir + reservoir_size - keep, keep);
+                memcpy(reservoir + keep, slot, slot_size);
+                reservoir_size = keep + slot_size;
+            }
+            return ok;
+        }
+    };
+
+    // appends frames to out with a fresh bit reservoir: each frame's main
+    // data goes as early as main_data_begin allows, and a frame whose data
+    // still does not fit is moved up to the next bitrate
+    class FrameWriter {
+        struct Slot {
+            uint64_t position; // in the main data areas written so far
+            size_t offset;     // in out
+            uint32_t size;
+        };
+
+        std::vector<uint8_t>* out;
+        std::vector<Slot> slots; // the areas main_data_begin can still reach
+        uint64_t position = 0;
+        uint64_t data_end = 0;   // where the last frame's main data ends
+
+    public:
+        std::vector<size_t> offsets; // of each frame in out
+        uint32_t resized = 0;
+        bool mixed_bitrates = false;
+
+        FrameWriter(std::vector<uint8_t>* out) : out(out) {}
+
+        // frame is the source frame, main_data its main data from a
+        // MainDataReader
+        bool write(const uint8_t* frame, const uint8_t* main_data, uint32_t length) {
+            uint8_t head[4];
+            memcpy(head, frame, 4);
+            MP3FrameHeader header = loadHeader(head);
+            uint32_t side_offset = 4 + (header.protection_bit ? 0 : 2);
+            uint32_t side_size = header.sideInfoSize();
+            uint32_t begin = (uint32_t)min<uint64_t>(position - data_end, kMaxReservoirSize);
+
+            bool resize = false;
+            while (length > begin + header.frameLength() - side_offset - side_size) {
+                if (header.bitrate_ind >= 14) return false;
+                head[2] += 0x10;
+                header = loadHeader(head);
+                resize = true;
+            }
+            resized += resize;
+            if (!offsets.empty() && (out->data()[offsets[0] + 2] >> 4) != header.bitrate_ind) {
+                mixed_bitrates = true;
+            }
+
+            size_t offset = out->size();
+            uint32_t frame_size = header.frameLength();
+            out->resize(offset + frame_size, 0);
+            uint8_t* dst = out->data() + offset;
+            memcpy(dst, head, 4);
+            memcpy(dst + side_offset, frame + side_offset, side_size);
+            dst[side_offset] = (uint8_t)(begin >> 1);
+            dst[side_offset + 1] = (uint8_t)((dst[side_offset + 1] & 0x7F) | (begin & 1) << 7);
+            if (!header.protection_bit) {
+                uint16_t crc = frameCRC(dst + 2, 2, 0xFFFF);
+                crc = frameCRC(dst + side_offset, side_size, crc);
+                dst[4] = (uint8_t)(crc >> 8);
+                dst[5] = (uint8_t)crc;
+            }
+            offsets.push_back(offset);
+            uint32_t slot_size = frame_size - side_offset - side_size;
+            slots.push_back(Slot{position, offset + side_offset + side_size, slot_size});
+
+            // the data starts begin bytes before this frame's own area
+            uint64_t at = position - begin;
+            uint32_t copied = 0;
+            for (const Slot& slot : slots) {
+                if (copied == length) break;
+                if (slot.position + slot.size <= at) continue;
+                uint32_t skip = (uint32_t)(at - slot.position);
+                uint32_t count = min(slot.size - skip, length - copied);
+                memcpy(out->data() + slot.offset + skip, main_data + copied, count);
+                copied += count;
+                at += count;
+            }
+            data_end = position - begin + length;
+            position += slot_size;
+
+            while (!slots.empty() && slots.front().position + slots.front().size + kMaxReservoirSize <= position) {
+                slots.erase(slots.begin());
+            }
+            return true;
+        }
+    };
+
+    // fills in the Info frame at the start of out once the audio is written
+    static void writeInfoFrame(std::vector<uint8_t>* out, const FrameWriter& writer, const SourceStream& source,
+                               const EditResult& result) {
+        uint8_t* frame = out->data();
+        MP3FrameHeader header = loadHeader(frame);
+        uint32_t info_size = header.frameLength();
+        uint8_t* xing = frame + 4 + header.sideInfoSize();
+        size_t total = out->size();
+        uint32_t frames = (uint32_t)writer.offsets.size();
+
+        memcpy(xing, writer.mixed_bitrates ? "Xing" : "Info", 4);
+        writeBE32(xing + 4, 0x0F); // frames, bytes, TOC, quality
+        writeBE32(xing + 8, frames);
+        writeBE32(xing + 12, (uint32_t)total);
+        // TOC: offset of the frame i% of the way in, in 256ths of the stream
+        for (int i = 0; i < 100; i++) {
+            size_t offset = writer.offsets[(uint64_t)frames * i / 100];
+            xing[16 + i] = (uint8_t)min<uint64_t>((uint64_t)offset * 256 / total, 255);
+        }
+        writeBE32(xing + 116, 0);
+
+        uint8_t* lame = xing + kXingSize;
+        if (source.info.has_lame) {
+            memcpy(lame, source.info.encoder, 9);
+        } else {
+            // decoders only read delay and padding behind a LAME or Lavf tag
+            memcpy(lame, "LAME3.100", 9);
+        }
+        MP3FrameHeader first = loadHeader(frame + info_size);
+        lame[20] = (uint8_t)min<uint32_t>(first.getBitrate() / 1000, 255);
+        lame[21] = (uint8_t)(result.encoder_delay >> 4);
+        lame[22] = (uint8_t)((result.encoder_delay & 0x0F) << 4 | result.encoder_padding >> 8);
+        lame[23] = (uint8_t)result.encoder_padding;
+        writeBE32(lame + 28, (uint32_t)total);
+        uint16_t music_crc = lameCRC(frame + info_size, total - info_size, 0);
+        lame[32] = (uint8_t)(music_crc >> 8);
+        lame[33] = (uint8_t)music_crc;
+        uint16_t tag_crc = lameCRC(frame, lame + 34 - frame, 0);
+        lame[34] = (uint8_t)(tag_crc >> 8);
+        lame[35] = (uint8_t)tag_crc;
+    }
+
+    EditResult spliceStreams(const EditSegment* segments, size_t count, std::vector<uint8_t>* out) {
+        EditResult result = {};
+        out->clear();
+        if (count == 0) {
+            result.status = EditStatus::kEmptyRange;
+            return result;
+        }
+
+        std::vector<SourceStream> sources(count);
+        for (size_t i = 0; i < count; i++) {
+            result.status = indexStream(segments[i], &sources[i]);
+            if (result.status != EditStatus::kOk) return result;
+            if (!sameStream(sources[0].first, sources[i].first)
+                || (sources[0].first.channel_mode == 3) != (sources[i].first.channel_mode == 3)) {
+                result.status = EditStatus::kMismatch;
+                return result;
+            }
+        }
+
+        // frames [begin[i], end[i]) of each source; the outer ends keep an
+        // extra frame in front (the IMDCT overlap and synthesis history) and
+        // kDecoderDelay behind, and are trimmed by the delay and padding
+        uint64_t spf = sources[0].first.samplesPerFrame();
+        std::vector<uint64_t> begin(count), end(count);
+        for (size_t i = 0; i < count; i++) {
+            const MP3Info& info = sources[i].info;
+            uint64_t num_frames = sources[i].frames.size();
+            uint64_t delay = info.encoder_delay;
+            uint64_t trimmed = delay + info.encoder_padding;
+            uint64_t available = num_frames * spf > trimmed ? num_frames * spf - trimmed : 0;
+            uint64_t start = segments[i].start;
+            uint64_t stop = min(segments[i].end, available);
+            if (start >= stop) {
+                result.status = EditStatus::kEmptyRange;
+                return result;
+            }
+
+            if (i == 0) {
+                begin[i] = (start + delay) / spf;
+                if (begin[i] > 0) begin[i]--;
+                result.encoder_delay = (uint32_t)(start + delay - begin[i] * spf);
+            } else {
+                begin[i] = (start + delay + spf / 2) / spf;
+            }
+            if (i == count - 1) {
+                end[i] = min(num_frames, (stop + delay + kDecoderDelay + spf - 1) / spf);
+                result.encoder_padding = (uint32_t)(end[i] * spf - stop - delay);
+            } else {
+                end[i] = min(num_frames, (stop + delay + spf / 2) / spf);
+            }
+            if (begin[i] >= end[i]) {
+                result.status = EditStatus::kEmptyRange;
+                return result;
+            }
+        }
+
+        // the Info frame: the first frame's header without CRC or padding, at
+        // the lowest bitrate that holds the tags
+        uint8_t head[4];
+        memcpy(head, segments[0].data + sources[0].frames[begin[0]], 4);
+        head[1] |= 0x01;
+        head[2] &= (uint8_t)~0x02;
+        MP3FrameHeader info_header = loadHeader(head);
+        uint32_t info_needed = 4 + info_header.sideInfoSize() + kXingSize + kLameSize;
+        for (uint32_t index = 1; index < 15; index++) {
+            head[2] = (uint8_t)((head[2] & 0x0F) | index << 4);
+            info_header = loadHeader(head);
+            if (info_header.frameLength() >= info_needed) break;
+        }
+        out->resize(info_header.frameLength(), 0);
+        memcpy(out->data(), head, 4);
+
+        FrameWriter writer(out);
+        uint8_t main_data[kMaxMainDataSize];
+        for (size_t i = 0; i < count; i++) {
+            const uint8_t* data = segments[i].data;
+            const std::vector<uint64_t>& frames = sources[i].frames;
+
+            // start early enough to fill the reservoir the first frame reaches into
+            uint64_t first = begin[i];
+            while (first > 0 && frames[begin[i]] - frames[first] < kMaxReservoirSize + kMaxMainDataSize) first--;
+
+            MainDataReader reader;
+            uint32_t length;
+            for (uint64_t f = first; f < end[i]; f++) {
+                bool ok = reader.read(data + frames[f], main_data, &length);
+                if (f < begin[i]) continue;
+                if (!ok) {
+                    result.status = EditStatus::kCorrupt;
+                    return result;
+                }
+                if (!writer.write(data + frames[f], main_data, length)) {
+                    result.status = EditStatus::kFrameTooLarge;
+                    return result;
+                }
+            }
+        }
+
+        result.frames = (uint32_t)writer.offsets.size();
+        result.resized_frames = writer.resized;
+        result.samples = result.frames * spf - result.encoder_delay - result.encoder_padding;
+        writeInfoFrame(out, writer, sources[0], result);
+        return result;
+    }
+
+    EditResult cutStream(const uint8_t* data, size_t size, uint64_t start, uint64_t end, std::vector<uint8_t>* out) {
+        EditSegment segment = {data, size, start, end};
+        return spliceStreams(&segment, 1, out);
+    }
+
+}
+
+}
+
+}
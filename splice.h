@@ -0,0 +1,66 @@
+#ifndef INCLUDE_KERNEL_IO_SPLICE_H_
+#define INCLUDE_KERNEL_IO_SPLICE_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // samples of filterbank delay a decoder puts before the first encoded
+    // sample; a cut keeps at least this much padding so the last wanted
+    // sample is still in the stream
+    static const uint32_t kDecoderDelay = 529;
+
+    enum class EditStatus {
+        kOk = 0,
+        kNotMP3,        // no MPEG-1 layer III frames found
+        kMismatch,      // segments differ in sample rate or channel mode
+        kEmptyRange,    // a segment selects no samples
+        kCorrupt,       // a frame's main data lies outside its stream
+        kFrameTooLarge, // a frame's main data does not fit even at 320 kbps
+    };
+
+    // samples [start, end) per channel of the MP3 file data/size (tags
+    // included), counted after the file's encoder delay; end is clamped to
+    // the end of the stream
+    struct EditSegment {
+        const uint8_t* data;
+        size_t size;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    struct EditResult {
+        EditStatus status;
+        uint32_t frames;          // audio frames written, the Info frame not counted
+        uint32_t resized_frames;  // frames moved to a higher bitrate to hold their main data
+        uint64_t samples;         // per channel, as the LAME tag reports them
+        uint32_t encoder_delay;
+        uint32_t encoder_padding;
+    };
+
+    // Concatenates the segments into a new stream in out without
+    // re-encoding. Whole frames are copied, main_data_begin is rewritten and
+    // the bit reservoir re-packed so no frame refers to data outside out, and
+    // a leading Info frame with a LAME tag carries the encoder delay and
+    // padding. The outer ends are sample-accurate (one extra frame in front
+    // primes the decoder); joins between segments fall on the nearest frame
+    // boundary. Segments must share sample rate and channel mode; bitrates
+    // may differ (the tag then says Xing instead of Info).
+    EditResult spliceStreams(const EditSegment* segments, size_t count, std::vector<uint8_t>* out);
+
+    // spliceStreams with a single segment
+    EditResult cutStream(const uint8_t* data, size_t size, uint64_t start, uint64_t end, std::vector<uint8_t>* out);
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_SPLICE_H_
@@ -0,0 +1,441 @@
+#include "stream_server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    uint64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    LatencyHistogram::LatencyHistogram() {
+        reset();
+    }
+
+    void LatencyHistogram::record(uint64_t us) {
+        int bucket = 0;
+        while (bucket < 31 && (1ull << bucket) <= us) bucket++;
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t LatencyHistogram::count() {
+        uint64_t total = 0;
+        for (int i = 0; i < 32; i++) total += buckets[i].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    uint64_t LatencyHistogram::quantile(double q) {
+        uint64_t total = count();
+        if (total == 0) return 0;
+        uint64_t target = (uint64_t)(q * total);
+        uint64_t seen = 0;
+        for (int i = 0; i < 32; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > target) return 1ull << i;
+        }
+        return 1ull << 31;
+    }
+
+    void LatencyHistogram::reset() {
+        for (int i = 0; i < 32; i++) buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    StreamServer::StreamServer(const StreamServerConfig& config) : config(config) {
+    }
+
+    StreamServer::~StreamServer() {
+        stop();
+        for (auto& worker : workers) {
+            if (worker.joinable()) worker.join();
+        }
+        for (auto& entry : streams) {
+            close(entry.first);
+            if (entry.second->sink_fd >= 0) close(entry.second->sink_fd);
+        }
+        for (int fd : listen_fds) close(fd);
+        if (!config.unix_path.empty()) unlink(config.unix_path.c_str());
+        if (wake_fd >= 0) close(wake_fd);
+        if (epoll_fd >= 0) close(epoll_fd);
+    }
+
+    bool StreamServer::listenTcp(int port) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return false;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+            perror("tcp listen");
+            close(fd);
+            return false;
+        }
+        listen_fds.push_back(fd);
+        return true;
+    }
+
+    bool StreamServer::listenUnix(const std::string& path) {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) return false;
+
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(path.c_str());
+        if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SOMAXCONN) != 0) {
+            perror("unix listen");
+            close(fd);
+            return false;
+        }
+        listen_fds.push_back(fd);
+        return true;
+    }
+
+    bool StreamServer::start() {
+        epoll_fd = epoll_create1(0);
+        wake_fd = eventfd(0, EFD_NONBLOCK);
+        if (epoll_fd < 0 || wake_fd < 0) return false;
+
+        if (config.tcp_port >= 0) listenTcp(config.tcp_port);
+        if (!config.unix_path.empty()) listenUnix(config.unix_path);
+        if (listen_fds.empty()) return false;
+
+        epoll_event event;
+        event.events = EPOLLIN;
+        for (int fd : listen_fds) {
+            event.data.fd = fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+        event.data.fd = wake_fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+
+        running = true;
+        for (int i = 0; i < config.num_workers; i++) {
+            workers.emplace_back(&StreamServer::workerLoop, this);
+        }
+        return true;
+    }
+
+    void StreamServer::stop() {
+        if (!running.exchange(false)) return;
+        queue_cv.notify_all();
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) < 0) {
+            // the I/O thread will still notice within a second
+        }
+    }
+
+    void StreamServer::run() {
+        epoll_event events[256];
+        uint64_t last_stats = nowNs();
+        while (running) {
+            int n = epoll_wait(epoll_fd, events, 256, 1000);
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == wake_fd) {
+                    uint64_t value;
+                    while (read(wake_fd, &value, sizeof(value)) > 0) {}
+                    std::vector<int> to_close;
+                    {
+                        std::lock_guard<std::mutex> guard(close_lock);
+                        to_close.swap(close_list);
+                    }
+                    for (int closing : to_close) closeStream(closing);
+                    continue;
+                }
+                if (std::find(listen_fds.begin(), listen_fds.end(), fd) != listen_fds.end()) {
+                    acceptConnections(fd);
+                    continue;
+                }
+
+                auto it = streams.find(fd);
+                if (it == streams.end()) continue;
+                std::shared_ptr<Stream> stream = it->second;
+                if (events[i].events & EPOLLOUT) handleWritable(stream);
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) handleReadable(stream);
+            }
+
+            uint64_t now = nowNs();
+            if (config.stats_interval > 0 && now - last_stats >= (uint64_t)config.stats_interval * 1000000000ull) {
+                printStats((now - last_stats) / 1e9);
+                last_stats = now;
+            }
+        }
+    }
+
+    void StreamServer::acceptConnections(int listen_fd) {
+        while (true) {
+            int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+            if (fd < 0) return;
+
+            auto stream = std::make_shared<Stream>();
+            stream->fd = fd;
+            stream->id = next_id++;
+            if (config.sink == SinkMode::kFile) {
+                std::string path = config.sink_dir + "/stream-" + std::to_string(stream->id) + ".pcm";
+                stream->sink_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            }
+            streams[fd] = stream;
+            stream->events = EPOLLIN;
+
+            epoll_event event;
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        }
+    }
+
+    // must hold stream->lock; reads pause while either backlog is over its
+    // limit and writes are only watched while there is unsent PCM
+    void StreamServer::updateEvents(Stream* stream) {
+        bool read = !stream->eof && stream->output.size() <= config.max_output_backlog
+            && stream->input.size() <= config.max_input_backlog;
+        uint32_t events = (read ? (uint32_t)EPOLLIN : 0) | (!stream->output.empty() ? (uint32_t)EPOLLOUT : 0);
+        if (events == stream->events) return;
+
+        epoll_event event;
+        event.events = events;
+        event.data.fd = stream->fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, stream->fd, &event);
+        stream->events = events;
+    }
+
+    void StreamServer::enqueue(const std::shared_ptr<Stream>& stream) {
+        {
+            std::lock_guard<std::mutex> guard(queue_lock);
+            work_queue.push_back(stream);
+        }
+        queue_cv.notify_one();
+    }
+
+    void StreamServer::handleReadable(const std::shared_ptr<Stream>& stream) {
+        uint8_t buffer[65536];
+        // a few reads per wakeup so one busy connection can't starve the rest
+        for (int i = 0; i < 4; i++) {
+            ssize_t ret = read(stream->fd, buffer, sizeof(buffer));
+            if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+
+            std::lock_guard<std::mutex> guard(stream->lock);
+            if (ret <= 0) {
+                // closed (or reset): decode what is left, then close
+                stream->eof = true;
+                updateEvents(stream.get());
+                if (!stream->queued) {
+                    stream->queued = true;
+                    enqueue(stream);
+                }
+                return;
+            }
+
+            total_bytes_in.fetch_add(ret, std::memory_order_relaxed);
+            if (stream->input.empty()) stream->input_since_ns = nowNs();
+            stream->input.insert(stream->input.end(), buffer, buffer + ret);
+            stream->backlog.fetch_add(ret, std::memory_order_relaxed);
+            if (!stream->queued) {
+                stream->queued = true;
+                enqueue(stream);
+            }
+            if (stream->input.size() > config.max_input_backlog) {
+                updateEvents(stream.get());
+                return;
+            }
+            if (ret < (ssize_t)sizeof(buffer)) return;
+        }
+    }
+
+    void StreamServer::handleWritable(const std::shared_ptr<Stream>& stream) {
+        bool done;
+        {
+            std::lock_guard<std::mutex> guard(stream->lock);
+            if (!stream->output.empty()) {
+                ssize_t ret = send(stream->fd, stream->output.data(), stream->output.size(), MSG_NOSIGNAL);
+                if (ret > 0) {
+                    stream->output.erase(stream->output.begin(), stream->output.begin() + ret);
+                    stream->backlog.fetch_sub(ret, std::memory_order_relaxed);
+                    total_bytes_out.fetch_add(ret, std::memory_order_relaxed);
+                } else if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                    // the peer is gone; nothing more can be delivered
+                    stream->output.clear();
+                    stream->eof = true;
+                }
+            }
+            updateEvents(stream.get());
+            done = stream->eof && !stream->queued && stream->output.empty() && !stream->closing;
+            if (done) stream->closing = true;
+        }
+        if (done) closeStream(stream->fd);
+    }
+
+    void StreamServer::closeStream(int fd) {
+        auto it = streams.find(fd);
+        if (it == streams.end()) return;
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        if (it->second->sink_fd >= 0) close(it->second->sink_fd);
+        streams.erase(it);
+    }
+
+    // must hold stream->lock
+    void StreamServer::sendOutput(Stream* stream, const uint8_t* data, size_t size) {
+        if (stream->output.empty()) {
+            ssize_t ret = send(stream->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (ret > 0) {
+                total_bytes_out.fetch_add(ret, std::memory_order_relaxed);
+                data += ret;
+                size -= ret;
+            } else if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                return;
+            }
+        }
+        if (size == 0) return;
+
+        // the socket is full, the I/O thread sends the rest
+        stream->output.insert(stream->output.end(), data, data + size);
+        stream->backlog.fetch_add(size, std::memory_order_relaxed);
+        updateEvents(stream);
+    }
+
+    // decodes one batch of the stream's frames; if there is more, the stream
+    // goes to the back of the queue so every stream gets its turn
+    void StreamServer::decodeStream(const std::shared_ptr<Stream>& stream, int16_t* pcm, size_t pcm_size) {
+        {
+            std::lock_guard<std::mutex> guard(stream->lock);
+            // leave the input where it is while plenty is pending, so the I/O
+            // thread sees the backlog and stops reading
+            if (!stream->input.empty() && stream->pending.size() < config.max_input_backlog) {
+                if (stream->pending.empty()) stream->pending_since_ns = stream->input_since_ns;
+                stream->pending.insert(stream->pending.end(), stream->input.begin(), stream->input.end());
+                stream->input.clear();
+                // reading may have been paused on the input backlog
+                updateEvents(stream.get());
+            }
+        }
+
+        // garbage is skipped without producing frames, keep going until a
+        // batch comes out or the input runs dry
+        uint64_t start = nowNs();
+        size_t offset = 0;
+        DecodeResult result;
+        do {
+            result = stream->decoder.decodeFrames(stream->pending.data() + offset,
+                stream->pending.size() - offset, pcm, pcm_size, config.frames_per_batch);
+            offset += result.bytes_consumed;
+        } while (result.frames == 0 && result.bytes_consumed > 0);
+        stream->pending.erase(stream->pending.begin(), stream->pending.begin() + offset);
+
+        bool more = result.frames == config.frames_per_batch;
+        if (result.frames > 0) {
+            uint64_t end = nowNs();
+            decode_time.record((end - start) / 1000);
+            // how long the oldest undecoded input of this stream had to wait
+            latency.record((end - stream->pending_since_ns) / 1000);
+            stream->frames.fetch_add(result.frames, std::memory_order_relaxed);
+            total_frames.fetch_add(result.frames, std::memory_order_relaxed);
+
+            const uint8_t* bytes = (const uint8_t*)pcm;
+            size_t size = result.samples * sizeof(int16_t);
+            if (config.sink == SinkMode::kEcho) {
+                std::lock_guard<std::mutex> guard(stream->lock);
+                sendOutput(stream.get(), bytes, size);
+            } else if (config.sink == SinkMode::kFile && stream->sink_fd >= 0) {
+                if (write(stream->sink_fd, bytes, size) < 0) {
+                    close(stream->sink_fd);
+                    stream->sink_fd = -1;
+                }
+            }
+        }
+
+        bool close_now = false;
+        {
+            std::lock_guard<std::mutex> guard(stream->lock);
+            stream->backlog.store(stream->input.size() + stream->pending.size() + stream->output.size(),
+                                  std::memory_order_relaxed);
+            if (more || !stream->input.empty()) {
+                // stay queued, behind everyone else
+                enqueue(stream);
+                return;
+            }
+            stream->queued = false;
+            if (stream->eof && stream->output.empty() && !stream->closing) {
+                stream->closing = true;
+                close_now = true;
+            }
+        }
+        if (close_now) {
+            std::lock_guard<std::mutex> guard(close_lock);
+            close_list.push_back(stream->fd);
+            uint64_t one = 1;
+            if (write(wake_fd, &one, sizeof(one)) < 0) {
+                // the eventfd counter can't overflow here
+            }
+        }
+    }
+
+    void StreamServer::workerLoop() {
+        std::vector<int16_t> pcm(2304 * config.frames_per_batch);
+        while (true) {
+            std::shared_ptr<Stream> stream;
+            {
+                std::unique_lock<std::mutex> guard(queue_lock);
+                queue_cv.wait(guard, [this] { return !work_queue.empty() || !running; });
+                if (!running) return;
+                stream = work_queue.front();
+                work_queue.pop_front();
+            }
+            decodeStream(stream, pcm.data(), pcm.size());
+        }
+    }
+
+    void StreamServer::printStats(double seconds) {
+        size_t total_backlog = 0;
+        size_t max_backlog = 0;
+        for (auto& entry : streams) {
+            size_t backlog = entry.second->backlog.load(std::memory_order_relaxed);
+            total_backlog += backlog;
+            max_backlog = max(max_backlog, backlog);
+        }
+        size_t queued;
+        {
+            std::lock_guard<std::mutex> guard(queue_lock);
+            queued = work_queue.size();
+        }
+
+        fprintf(stderr, "streams %zu | frames/s %.0f | in %.2f MB/s | out %.2f MB/s | "
+                "latency us p50 %llu p99 %llu p99.9 %llu | batch us p50 %llu p99 %llu | "
+                "backlog max %zu total %zu | queued %zu\n",
+                streams.size(), total_frames.exchange(0) / seconds,
+                total_bytes_in.exchange(0) / seconds / 1e6, total_bytes_out.exchange(0) / seconds / 1e6,
+                (unsigned long long)latency.quantile(0.5), (unsigned long long)latency.quantile(0.99),
+                (unsigned long long)latency.quantile(0.999),
+                (unsigned long long)decode_time.quantile(0.5), (unsigned long long)decode_time.quantile(0.99),
+                max_backlog, total_backlog, queued);
+        latency.reset();
+        decode_time.reset();
+    }
+
+}
+
+}
+
+}
@@ -0,0 +1,145 @@
+#ifndef INCLUDE_KERNEL_IO_STREAM_SERVER_H_
+#define INCLUDE_KERNEL_IO_STREAM_SERVER_H_
+
+#include "stdint.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "mp3.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // where decoded PCM goes
+    enum class SinkMode {
+        kEcho = 0, // back over the connection the MP3 came in on
+        kNull,     // discarded (decode only)
+        kFile,     // <sink_dir>/stream-<id>.pcm
+    };
+
+    struct StreamServerConfig {
+        int tcp_port = -1;        // -1: no TCP listener
+        std::string unix_path;    // empty: no Unix socket listener
+        int num_workers = 4;
+        SinkMode sink = SinkMode::kEcho;
+        std::string sink_dir;
+        int stats_interval = 5;   // seconds between stats lines, 0 for none
+        // stop reading from a connection while this much PCM is waiting to be
+        // sent or this much MP3 is waiting to be decoded
+        size_t max_output_backlog = 1 << 20;
+        size_t max_input_backlog = 1 << 18;
+        // frames decoded per turn before a stream goes to the back of the queue
+        uint32_t frames_per_batch = 16;
+    };
+
+    // log2 histogram of microsecond latencies, safe to update from any thread
+    struct LatencyHistogram {
+        std::atomic<uint64_t> buckets[32];
+
+        LatencyHistogram();
+        void record(uint64_t us);
+        // upper bound (us) of the bucket holding the given quantile
+        uint64_t quantile(double q);
+        uint64_t count();
+        void reset();
+    };
+
+    // one connection: its decoder, the bytes that arrived but have not been
+    // decoded and the PCM that has not been sent
+    struct Stream {
+        int fd;
+        uint64_t id;
+        int sink_fd = -1;
+        MP3FrameDecoder decoder;
+
+        // guards everything below; the I/O thread appends input, a worker
+        // consumes it
+        std::mutex lock;
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        bool queued = false;
+        bool eof = false;
+        bool closing = false;
+        uint32_t events = 0; // what the fd is registered for in epoll
+        uint64_t input_since_ns = 0; // when input went from empty to non-empty
+
+        // only touched by the worker that holds the stream
+        std::vector<uint8_t> pending;
+        uint64_t pending_since_ns = 0;
+
+        std::atomic<size_t> backlog{0}; // undecoded input + unsent output bytes
+        std::atomic<uint64_t> frames{0};
+    };
+
+    // Accepts MP3 byte streams on TCP and/or Unix sockets with one epoll
+    // thread and decodes them on a fixed pool of workers; connections never
+    // get a thread of their own.
+    class StreamServer {
+        StreamServerConfig config;
+        int epoll_fd = -1;
+        int wake_fd = -1; // eventfd: workers ask the I/O thread to close streams
+        std::vector<int> listen_fds;
+        std::atomic<bool> running{false};
+        uint64_t next_id = 0;
+
+        // owned by the I/O thread
+        std::unordered_map<int, std::shared_ptr<Stream>> streams;
+
+        std::mutex queue_lock;
+        std::condition_variable queue_cv;
+        std::deque<std::shared_ptr<Stream>> work_queue;
+
+        std::mutex close_lock;
+        std::vector<int> close_list;
+
+        std::vector<std::thread> workers;
+
+        // stats
+        LatencyHistogram latency;       // input arrival to its PCM coming out
+        LatencyHistogram decode_time;   // per decoded batch
+        std::atomic<uint64_t> total_frames{0};
+        std::atomic<uint64_t> total_bytes_in{0};
+        std::atomic<uint64_t> total_bytes_out{0};
+
+        bool listenTcp(int port);
+        bool listenUnix(const std::string& path);
+        void acceptConnections(int listen_fd);
+        void handleReadable(const std::shared_ptr<Stream>& stream);
+        void handleWritable(const std::shared_ptr<Stream>& stream);
+        void closeStream(int fd);
+        void updateEvents(Stream* stream);
+        void enqueue(const std::shared_ptr<Stream>& stream);
+        void workerLoop();
+        void decodeStream(const std::shared_ptr<Stream>& stream, int16_t* pcm, size_t pcm_size);
+        void sendOutput(Stream* stream, const uint8_t* data, size_t size);
+        void printStats(double seconds);
+
+    public:
+        StreamServer(const StreamServerConfig& config);
+        ~StreamServer();
+
+        // opens the listeners; false if none could be opened
+        bool start();
+        // runs the event loop until stop() is called
+        void run();
+        void stop();
+    };
+
+    uint64_t nowNs();
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_STREAM_SERVER_H_
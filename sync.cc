@@ -0,0 +1,103 @@
+#include "sync.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    size_t scanSyncWord(const uint8_t* data, size_t size) {
+        size_t i = 0;
+        if (size < 2) return size;
+
+        // compare data[i] against 0xFF and data[i+1] & 0xE0 against 0xE0 for a
+        // whole vector of i at once; the second load is the first shifted by one
+#if defined(__AVX2__)
+        const __m256i ff = _mm256_set1_epi8((char)0xFF);
+        const __m256i e0 = _mm256_set1_epi8((char)0xE0);
+        for (; i + 33 <= size; i += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(data + i));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(data + i + 1));
+            __m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(a, ff),
+                                             _mm256_cmpeq_epi8(_mm256_and_si256(b, e0), e0));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+            if (mask) return i + __builtin_ctz(mask);
+        }
+#elif defined(__SSE2__)
+        const __m128i ff = _mm_set1_epi8((char)0xFF);
+        const __m128i e0 = _mm_set1_epi8((char)0xE0);
+        for (; i + 17 <= size; i += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+            __m128i b = _mm_loadu_si128((const __m128i*)(data + i + 1));
+            __m128i match = _mm_and_si128(_mm_cmpeq_epi8(a, ff),
+                                          _mm_cmpeq_epi8(_mm_and_si128(b, e0), e0));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+            if (mask) return i + __builtin_ctz(mask);
+        }
+#endif
+
+        for (; i + 1 < size; i++) {
+            if (data[i] == 0xFF && (data[i + 1] & 0xE0) == 0xE0) return i;
+        }
+        return size;
+    }
+
+    bool validateChain(const uint8_t* data, size_t size, size_t offset, int chain, bool eof, bool* truncated) {
+        *truncated = false;
+        if (offset + 4 > size) {
+            *truncated = true;
+            return eof;
+        }
+
+        MP3FrameHeader first = loadHeader(data + offset);
+        if (!first.isValid()) return false;
+
+        size_t next = offset;
+        MP3FrameHeader header = first;
+        for (int i = 0; i < chain; i++) {
+            next += header.frameLength();
+            if (next + 4 > size) {
+                *truncated = true;
+                // the last frame may end exactly at the end of the stream
+                return eof && next <= size;
+            }
+            header = loadHeader(data + next);
+            if (!header.isValid() || !sameStream(first, header)) return false;
+        }
+        return true;
+    }
+
+    SyncResult findFrame(const uint8_t* data, size_t size, size_t* offset, int chain, bool eof) {
+        size_t i = 0;
+        while (i + 4 <= size) {
+            i += scanSyncWord(data + i, size - i);
+            if (i + 4 > size) break;
+
+            bool truncated;
+            if (validateChain(data, size, i, chain, eof, &truncated)) {
+                *offset = i;
+                return SyncResult::kFound;
+            }
+            if (truncated && !eof) {
+                // the candidate's header is fine so far, the chain just needs
+                // more bytes to be confirmed
+                *offset = i;
+                return SyncResult::kNeedMoreData;
+            }
+            i++;
+        }
+
+        // keep the last 3 bytes in case a header starts there
+        *offset = size > 3 ? size - 3 : 0;
+        return SyncResult::kNotFound;
+    }
+
+}
+
+}
+
+}
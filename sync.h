@@ -0,0 +1,51 @@
+#ifndef INCLUDE_KERNEL_IO_SYNC_H_
+#define INCLUDE_KERNEL_IO_SYNC_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include "mp3.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    // number of further headers a candidate's frameLength() chain has to
+    // land on before we trust it
+    static const int kDefaultChainLength = 3;
+
+    enum class SyncResult {
+        kFound = 0,
+        kNotFound,     // no frame starts in the buffer
+        kNeedMoreData, // a candidate's chain runs past the end of the buffer
+    };
+
+    // true if b can follow a in the same stream
+    inline bool sameStream(MP3FrameHeader a, MP3FrameHeader b) {
+        return a.version_id == b.version_id
+            && a.layer_desc == b.layer_desc
+            && a.sampling_rate_ind == b.sampling_rate_ind;
+    }
+
+    // index of the first 0xFF 0xE? byte pair in data, size if there is none
+    size_t scanSyncWord(const uint8_t* data, size_t size);
+
+    // true if the header at offset is valid and its chain lands on `chain`
+    // further consistent headers; if the chain leaves the buffer, returns
+    // eof (a stream may end on any frame) and sets *truncated
+    bool validateChain(const uint8_t* data, size_t size, size_t offset, int chain, bool eof, bool* truncated);
+
+    // finds the first frame at or after data that passes validateChain; on
+    // kFound and kNeedMoreData *offset is the candidate, on kNotFound it is
+    // the number of bytes that can be dropped before scanning again
+    SyncResult findFrame(const uint8_t* data, size_t size, size_t* offset,
+                         int chain = kDefaultChainLength, bool eof = false);
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_SYNC_H_
@@ -2,6 +2,7 @@
 #define INCLUDE_KERNEL_IO_TABLES_H_
 
 #include "stdint.h"
+#include "math.h"
 
 namespace io {
 
@@ -14,7 +15,7 @@ namespace mp3 {
     // Column 2: V1, L3
     // Column 3: V2, L1
     // Column 4: V2, L2, L3
-    static const uint32_t kBitRates [16][5] = {
+    static constexpr uint32_t kBitRates [16][5] = {
             {0, 0, 0, 0, 0},
             {32, 32, 32, 32, 8},
             {64, 48, 40, 48, 16},
@@ -37,14 +38,14 @@ namespace mp3 {
     // Column 0: V1
     // Column 1: V2
     // Column 3: V2.5
-    const uint32_t kSamplingRates [4][3] = {
+    static constexpr uint32_t kSamplingRates [4][3] = {
             {44100, 22050, 11025},
             {48000, 24000, 12000},
             {32000, 16000, 8000},
             {0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}
     };
 
-    static const struct {
+    static constexpr struct {
         const unsigned long_32[22] {
             4, 4, 4, 4, 4, 4, 6, 6, 8, 10, 12, 16, 20, 24, 30, 38, 46, 56, 68, 84, 102
         };
@@ -65,7 +66,7 @@ namespace mp3 {
         };
     } kBandWidthTable;
     
-    static const struct {
+    static constexpr struct {
         const unsigned long_32[23] {
             0, 4, 8, 12, 16, 20, 24, 30, 36, 44, 54, 66, 82,
             102, 126, 156, 194, 240, 296, 364, 448, 550, 576
@@ -89,7 +90,104 @@ namespace mp3 {
         };
     } kBandIndexTable;
 
-    static const struct {
+    // Where each line of a short block granule comes from once it is
+    // reordered from band/window order into subband order (18 lines per
+    // subband: 6 of window 0, 6 of window 1, 6 of window 2). 576 means the
+    // line stays zero: only the first 12 short bands are reordered.
+    static constexpr struct ReorderTables {
+        uint16_t source[3][576] {};
+
+        constexpr ReorderTables() {
+            const unsigned* widths[3] = {kBandWidthTable.short_44, kBandWidthTable.short_48, kBandWidthTable.short_32};
+            for (int rate = 0; rate < 3; rate++) {
+                for (int i = 0; i < 576; i++) source[rate][i] = 576;
+                uint32_t start = 0;
+                for (int sfb = 0; sfb < 12; sfb++) {
+                    uint32_t width = widths[rate][sfb];
+                    for (uint32_t i = 0; i < width; i++) {
+                        uint32_t line = start + i;
+                        for (uint32_t win = 0; win < 3; win++) {
+                            source[rate][18 * (line / 6) + line % 6 + 6 * win] = 3 * start + width * win + i;
+                        }
+                    }
+                    start += width;
+                }
+            }
+        }
+    } kReorderTables;
+
+    // scalefactor band tables of one MPEG-1 sampling rate
+    struct BandTables {
+        const unsigned* index_long;
+        const unsigned* index_short;
+        const unsigned* width_long;
+        const unsigned* width_short;
+        const uint16_t* reorder;
+    };
+
+    // indexed by sampling_rate_ind
+    static constexpr BandTables kBandTables[3] = {
+        {kBandIndexTable.long_44, kBandIndexTable.short_44, kBandWidthTable.long_44, kBandWidthTable.short_44,
+         kReorderTables.source[0]},
+        {kBandIndexTable.long_48, kBandIndexTable.short_48, kBandWidthTable.long_48, kBandWidthTable.short_48,
+         kReorderTables.source[1]},
+        {kBandIndexTable.long_32, kBandIndexTable.short_32, kBandWidthTable.long_32, kBandWidthTable.short_32,
+         kReorderTables.source[2]},
+    };
+
+    // everything the version, layer, bitrate and sampling rate bits of a
+    // frame header determine; all zero where one of them is reserved (or the
+    // bitrate is free format)
+    struct HeaderInfo {
+        const BandTables* bands;    // nullptr for MPEG-2 and 2.5 rates
+        uint32_t bitrate;           // bits per second
+        uint16_t sampling_rate;     // Hz
+        uint16_t frame_length[2];   // header included, indexed by padding_bit
+        uint16_t samples_per_frame;
+        uint8_t side_info_size[2];  // layer 3, indexed by channel_mode == 3 (mono)
+        bool valid;
+    };
+
+    // indexed by version_id << 8 | layer_desc << 6 | bitrate_ind << 2 | sampling_rate_ind
+    static constexpr struct HeaderTable {
+        HeaderInfo info[1024] {};
+
+        constexpr HeaderTable() {
+            for (uint32_t key = 0; key < 1024; key++) {
+                uint32_t version = key >> 8;
+                uint32_t layer = key >> 6 & 3;
+                uint32_t bitrate_ind = key >> 2 & 15;
+                uint32_t rate_ind = key & 3;
+                if (version == 1 || layer == 0 || bitrate_ind == 0 || bitrate_ind == 15 || rate_ind == 3) {
+                    continue;
+                }
+
+                // version 3 is MPEG-1, 2 is MPEG-2 and 0 is MPEG-2.5; layer 3 is
+                // layer I and 1 is layer III
+                bool mpeg1 = version == 3;
+                uint32_t column = mpeg1 ? 3 - layer : (layer == 3 ? 3 : 4);
+                uint32_t rate_column = mpeg1 ? 0 : (version == 2 ? 1 : 2);
+                HeaderInfo& entry = info[key];
+                entry.bands = mpeg1 ? &kBandTables[rate_ind] : nullptr;
+                entry.bitrate = kBitRates[bitrate_ind][column] * 1000;
+                entry.sampling_rate = kSamplingRates[rate_ind][rate_column];
+                if (layer == 3) {
+                    entry.samples_per_frame = 384;
+                    entry.frame_length[0] = 12 * entry.bitrate / entry.sampling_rate * 4;
+                    entry.frame_length[1] = entry.frame_length[0] + 4;
+                } else {
+                    entry.samples_per_frame = layer == 1 && !mpeg1 ? 576 : 1152;
+                    entry.frame_length[0] = entry.samples_per_frame / 8 * entry.bitrate / entry.sampling_rate;
+                    entry.frame_length[1] = entry.frame_length[0] + 1;
+                }
+                entry.side_info_size[0] = mpeg1 ? 32 : 17;
+                entry.side_info_size[1] = mpeg1 ? 17 : 9;
+                entry.valid = true;
+            }
+        }
+    } kHeaderTable;
+
+    static constexpr struct {
         const unsigned char value[16][4] {
             {0, 0, 0, 0}, {0, 0, 0, 1}, {0, 0, 1, 0}, {0, 0, 1, 1}, {0, 1, 0, 0}, {0, 1, 0, 1},
             {0, 1, 1, 0}, {0, 1, 1, 1}, {1, 0, 0, 0}, {1, 0, 0, 1}, {1, 0, 1, 0}, {1, 0, 1, 1},
@@ -102,9 +200,28 @@ namespace mp3 {
         };
     } kQuadTable;
 
+    // count1 table A by the next 6 bits: code length << 4 | quad, where the
+    // quad holds the four values (0 or 1) from bit 3 down, as in value above
+    struct QuadLookup {
+        uint8_t entry[64];
+
+        constexpr QuadLookup() : entry() {
+            for (unsigned peek = 0; peek < 64; peek++)
+                for (unsigned quad = 0; quad < 16; quad++) {
+                    unsigned length = kQuadTable.hlen[quad];
+                    if (kQuadTable.hcod[quad] >> (32 - length) == peek >> (6 - length)) {
+                        entry[peek] = (uint8_t)(length << 4 | quad);
+                        break;
+                    }
+                }
+        }
+    };
+
+    static constexpr QuadLookup kQuadLookup;
+
 
     // kSlenTable[x][y] = slen(y+1) for scalefac_compress = x
-    static const uint32_t kSlenTable [16][2] = {
+    static constexpr uint32_t kSlenTable [16][2] = {
             {0, 0},
             {0, 1},
             {0, 2},
@@ -123,6 +240,54 @@ namespace mp3 {
             {4, 3}
     };
 
+    // scalefactor layouts for unpackScalefacs: the scalefactors of a granule
+    // as runs that share a bit width, each short enough (at most 9 values
+    // of 4 bits) to come out of one 64-bit window
+    enum ScalefacBlock {
+        kScalefacLong = 0,
+        kScalefacShort,
+        kScalefacMixed,
+    };
+
+    struct ScalefacGroup {
+        uint8_t count;
+        uint8_t bits;      // 0: the values are zero and nothing is read
+        bool is_short;     // into scalefac_s (band major, [13][3]) rather than scalefac_l
+        uint8_t first;     // index of the first value in its array
+        uint8_t scfsi;     // long blocks: the scfsi band that lets granule 1 copy the run, 4 if none
+    };
+
+    struct ScalefacLayout {
+        uint8_t num_groups;
+        ScalefacGroup groups[5];
+    };
+
+    struct ScalefacLayouts {
+        ScalefacLayout layout[3][16]; // by ScalefacBlock and scalefac_compress
+
+        constexpr ScalefacLayouts() : layout() {
+            for (int compress = 0; compress < 16; compress++) {
+                uint8_t slen1 = (uint8_t)kSlenTable[compress][0];
+                uint8_t slen2 = (uint8_t)kSlenTable[compress][1];
+
+                // bands 0-5, 6-10, 11-15, 16-20, and the unused band 21
+                layout[kScalefacLong][compress] = {5, {
+                    {6, slen1, false, 0, 0}, {5, slen1, false, 6, 1}, {5, slen2, false, 11, 2},
+                    {5, slen2, false, 16, 3}, {1, 0, false, 21, 4}}};
+                // bands 0-5 and 6-11 of all three windows, and band 12
+                layout[kScalefacShort][compress] = {5, {
+                    {9, slen1, true, 0, 4}, {9, slen1, true, 9, 4}, {9, slen2, true, 18, 4},
+                    {9, slen2, true, 27, 4}, {3, 0, true, 36, 4}}};
+                // long bands 0-7, then short bands 3-5, 6-11 and 12
+                layout[kScalefacMixed][compress] = {5, {
+                    {8, slen1, false, 0, 4}, {9, slen1, true, 9, 4}, {9, slen2, true, 18, 4},
+                    {9, slen2, true, 27, 4}, {3, 0, true, 36, 4}}};
+            }
+        }
+    };
+
+    static constexpr ScalefacLayouts kScalefacLayouts;
+
 const uint32_t kNumHuffmanTables = 34;
 
 // kHuffmanTableMetadata[x][0] = rows in xth table (xlen)
@@ -256,7 +421,7 @@ static const float kCA[8] {
         -.0945741925, -.0409655829, -.0141985686, -.0036999747
 };
 
-static const double kSynthWindow[512] {
+static constexpr float kSynthWindow[512] {
         0.000000000, -0.000015259, -0.000015259, -0.000015259, -0.000015259, -0.000015259,
         -0.000015259, -0.000030518, -0.000030518, -0.000030518, -0.000030518, -0.000045776,
         -0.000045776, -0.000061035, -0.000061035, -0.000076294, -0.000076294, -0.000091553,
@@ -345,6 +510,62 @@ static const double kSynthWindow[512] {
         0.000015259,  0.000015259
 };
 
+
+// IMDCT windows and cosines, one row per output sample so the inner loop
+// over the input lines is contiguous
+struct IMDCTTables {
+    float window[4][36];    // by block type
+    float long_cos[36][18]; // cos(pi / 72 * (2i + 19) * (2k + 1))
+    float short_cos[12][6]; // cos(pi / 24 * (2i + 7) * (2k + 1))
+
+    constexpr IMDCTTables() : window(), long_cos(), short_cos() {
+        using util::math::M_PI;
+        using util::math::sinConst;
+        using util::math::cosConst;
+        for (int i = 0; i < 36; i++) {
+            window[0][i] = (float)sinConst(M_PI / 36.0 * (i + 0.5));
+        }
+        for (int i = 0; i < 18; i++) {
+            window[1][i] = window[0][i];
+            window[3][i + 18] = window[0][i + 18];
+        }
+        for (int i = 18; i < 24; i++) {
+            window[1][i] = 1.0f;
+            window[3][i - 6] = 1.0f;
+        }
+        for (int i = 24; i < 30; i++) {
+            window[1][i] = (float)sinConst(M_PI / 12.0 * (i - 18.0 + 0.5));
+        }
+        for (int i = 0; i < 12; i++) {
+            window[2][i] = (float)sinConst(M_PI / 12.0 * (i + 0.5));
+        }
+        for (int i = 6; i < 12; i++) {
+            window[3][i] = (float)sinConst(M_PI / 12.0 * (i - 6.0 + 0.5));
+        }
+        for (int i = 0; i < 36; i++)
+            for (int k = 0; k < 18; k++)
+                long_cos[i][k] = (float)cosConst(M_PI / 72.0 * (2 * i + 1 + 18) * (2 * k + 1));
+        for (int i = 0; i < 12; i++)
+            for (int k = 0; k < 6; k++)
+                short_cos[i][k] = (float)cosConst(M_PI / 24.0 * (2 * i + 1 + 6) * (2 * k + 1));
+    }
+};
+
+static constexpr IMDCTTables kIMDCTTables;
+
+// synthesis matrixing: cos((16 + i) * (2j + 1) * pi / 64)
+struct SynthTables {
+    float cos[64][32];
+
+    constexpr SynthTables() : cos() {
+        for (int i = 0; i < 64; i++)
+            for (int j = 0; j < 32; j++)
+                cos[i][j] = (float)util::math::cosConst((16.0 + i) * (2.0 * j + 1.0) * (util::math::M_PI / 64.0));
+    }
+};
+
+static constexpr SynthTables kSynthTables;
+
 }
 
 }
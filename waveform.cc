@@ -0,0 +1,189 @@
+#include "waveform.h"
+#include <cmath>
+#include <cstring>
+#include "mp3.h"
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    typedef float Float4 __attribute__((vector_size(16)));
+
+    // min, max and sum of squares of a run, folded into lo/hi/energy, two
+    // vectors of four at a time
+    static inline void scanRun(const float* in, uint32_t length, float* lo, float* hi, double* energy) {
+        Float4 mins[2], maxs[2], squares[2];
+        for (int j = 0; j < 2; j++) {
+            mins[j] = Float4{} + *lo;
+            maxs[j] = Float4{} + *hi;
+            squares[j] = Float4{};
+        }
+        uint32_t i = 0;
+        for (; i + 8 <= length; i += 8)
+            for (int j = 0; j < 2; j++) {
+                Float4 x;
+                memcpy(&x, in + i + 4 * j, sizeof(x));
+                mins[j] = x < mins[j] ? x : mins[j];
+                maxs[j] = x > maxs[j] ? x : maxs[j];
+                squares[j] += x * x;
+            }
+        double sum = 0;
+        for (int k = 0; k < 4; k++)
+            for (int j = 0; j < 2; j++) {
+                *lo = mins[j][k] < *lo ? mins[j][k] : *lo;
+                *hi = maxs[j][k] > *hi ? maxs[j][k] : *hi;
+                sum += squares[j][k];
+            }
+        for (; i < length; i++) {
+            float x = in[i];
+            *lo = x < *lo ? x : *lo;
+            *hi = x > *hi ? x : *hi;
+            sum += x * x;
+        }
+        *energy += sum;
+    }
+
+    WaveformBuilder::WaveformBuilder(const WaveformConfig& config) : config(config) {
+        if (this->config.levels > kMaxWaveformLevels) this->config.levels = kMaxWaveformLevels;
+        if (this->config.levels == 0) this->config.levels = 1;
+        if (this->config.base_bucket == 0) this->config.base_bucket = 1;
+        if (this->config.factor < 2) this->config.factor = 2;
+        reset();
+    }
+
+    void WaveformBuilder::clear(Accumulator& acc) {
+        for (int ch = 0; ch < 2; ch++) {
+            acc.min[ch] = HUGE_VALF;
+            acc.max[ch] = -HUGE_VALF;
+            acc.energy[ch] = 0;
+        }
+        acc.fill = 0;
+        acc.samples = 0;
+    }
+
+    void WaveformBuilder::reset(uint64_t skip, uint64_t length) {
+        channels = 0;
+        sample_rate = 0;
+        this->skip = skip;
+        remaining = length;
+        samples = 0;
+        for (uint32_t level = 0; level < config.levels; level++) {
+            clear(accumulators[level]);
+            levels[level].clear();
+        }
+    }
+
+    void WaveformBuilder::addSamples(const float* const* in, uint32_t channels, uint32_t length, uint32_t rate) {
+        this->channels = channels;
+        sample_rate = rate;
+        Accumulator& acc = accumulators[0];
+        uint32_t i = 0;
+        if (skip) {
+            uint32_t dropped = skip < length ? (uint32_t)skip : length;
+            skip -= dropped;
+            i = dropped;
+        }
+        while (i < length && remaining) {
+            uint64_t run = length - i;
+            if (run > config.base_bucket - acc.fill) run = config.base_bucket - acc.fill;
+            if (run > remaining) run = remaining;
+            for (uint32_t ch = 0; ch < channels; ch++)
+                scanRun(in[ch] + i, (uint32_t)run, &acc.min[ch], &acc.max[ch], &acc.energy[ch]);
+            acc.fill += run;
+            acc.samples += run;
+            samples += run;
+            remaining -= run;
+            i += run;
+            if (acc.fill == config.base_bucket) emit(0, false);
+        }
+    }
+
+    // appends the level's bucket in progress and merges it into the next
+    // level, which is emitted in turn once it has factor buckets (or, when
+    // partial, is left for finish)
+    void WaveformBuilder::emit(uint32_t level, bool partial) {
+        Accumulator& acc = accumulators[level];
+        for (uint32_t ch = 0; ch < channels; ch++) {
+            float rms = std::sqrt((float)(acc.energy[ch] / acc.samples));
+            levels[level].push_back({scalePCM(acc.min[ch]), scalePCM(acc.max[ch]), scalePCM(rms)});
+        }
+
+        if (level + 1 < config.levels) {
+            Accumulator& next = accumulators[level + 1];
+            for (uint32_t ch = 0; ch < channels; ch++) {
+                next.min[ch] = acc.min[ch] < next.min[ch] ? acc.min[ch] : next.min[ch];
+                next.max[ch] = acc.max[ch] > next.max[ch] ? acc.max[ch] : next.max[ch];
+                next.energy[ch] += acc.energy[ch];
+            }
+            next.fill++;
+            next.samples += acc.samples;
+            clear(acc);
+            if (!partial && next.fill == config.factor) emit(level + 1, false);
+        } else {
+            clear(acc);
+        }
+    }
+
+    void WaveformBuilder::finish() {
+        for (uint32_t level = 0; level < config.levels; level++)
+            if (accumulators[level].fill) emit(level, true);
+    }
+
+    size_t WaveformBuilder::fileSize() const {
+        size_t total = sizeof(WaveformHeader);
+        for (uint32_t level = 0; level < config.levels; level++)
+            total += levels[level].size() * sizeof(WaveformBucket);
+        return total;
+    }
+
+    size_t WaveformBuilder::writeFile(uint8_t* out, size_t size) const {
+        size_t total = fileSize();
+        if (size < total) return 0;
+
+        WaveformHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = kWaveformMagic;
+        header.version = kWaveformVersion;
+        header.channels = channels;
+        header.sampling_rate = sample_rate;
+        header.num_levels = config.levels;
+        header.samples = samples;
+        uint64_t offset = sizeof(WaveformHeader);
+        uint32_t bucket = config.base_bucket;
+        for (uint32_t level = 0; level < config.levels; level++, bucket *= config.factor) {
+            size_t bytes = levels[level].size() * sizeof(WaveformBucket);
+            header.levels[level].samples_per_bucket = bucket;
+            header.levels[level].offset = offset;
+            header.levels[level].buckets = channels ? levels[level].size() / channels : 0;
+            memcpy(out + offset, levels[level].data(), bytes);
+            offset += bytes;
+        }
+        memcpy(out, &header, sizeof(header));
+        return total;
+    }
+
+    const WaveformHeader* mapWaveform(const uint8_t* data, size_t size) {
+        if (size < sizeof(WaveformHeader) || (uintptr_t)data % alignof(WaveformHeader)) return nullptr;
+        const WaveformHeader* header = (const WaveformHeader*)data;
+        if (header->magic != kWaveformMagic || header->version != kWaveformVersion
+            || header->num_levels == 0 || header->num_levels > kMaxWaveformLevels
+            || header->channels == 0 || header->channels > 2) {
+            return nullptr;
+        }
+        for (uint32_t level = 0; level < header->num_levels; level++) {
+            const WaveformLevel& info = header->levels[level];
+            uint64_t bytes = info.buckets * header->channels * sizeof(WaveformBucket);
+            if (info.buckets > size || info.offset % alignof(WaveformBucket) || info.offset > size
+                || bytes > size - info.offset)
+                return nullptr;
+        }
+        return header;
+    }
+
+}
+
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef INCLUDE_KERNEL_IO_WAVEFORM_H_
+#define INCLUDE_KERNEL_IO_WAVEFORM_H_
+
+#include "stdint.h"
+#include <cstddef>
+#include <vector>
+
+namespace io {
+
+namespace audio {
+
+namespace mp3 {
+
+    static const uint32_t kWaveformMagic = 0x5733504D; // "MP3W"
+    static const uint16_t kWaveformVersion = 1;
+    static const uint32_t kMaxWaveformLevels = 8;
+
+    // level i has base_bucket * factor^i samples per bucket
+    struct WaveformConfig {
+        uint32_t base_bucket = 256;
+        uint32_t factor = 4;
+        uint32_t levels = 3;        // 256 / 1024 / 4096, at most kMaxWaveformLevels
+    };
+
+    // one channel over one bucket, on the int16 PCM scale
+    struct WaveformBucket {
+        int16_t min;
+        int16_t max;
+        int16_t rms;
+    };
+
+    struct WaveformLevel {
+        uint32_t samples_per_bucket;
+        uint32_t reserved;
+        uint64_t offset;   // of the first bucket, in bytes from the start of the file
+        uint64_t buckets;  // per channel; bucket b of channel ch is at b * channels + ch
+    };
+
+    // Overview file layout, native byte order: this header, then each
+    // level's buckets. Every field is naturally aligned, so a mapped file
+    // is used in place (see mapWaveform).
+    struct WaveformHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t channels;
+        uint32_t sampling_rate;
+        uint32_t num_levels;
+        uint64_t samples;   // per channel
+        WaveformLevel levels[kMaxWaveformLevels];
+    };
+
+    // Builds min/max/RMS overviews at several zoom levels from the
+    // decoder's synthesis output (attach it with
+    // MP3FrameDecoder::setWaveform), so the decoded PCM is never read a
+    // second time. Only the finest level looks at samples; each coarser
+    // bucket is merged from factor finer ones as they complete.
+    class WaveformBuilder {
+        // a bucket in progress, kept as floats and a sum of squares
+        struct Accumulator {
+            float min[2];
+            float max[2];
+            double energy[2];
+            uint32_t fill;     // samples (base level) or buckets merged (others)
+            uint64_t samples;
+        };
+
+        WaveformConfig config;
+        uint32_t channels = 0;
+        uint32_t sample_rate = 0;
+        uint64_t skip = 0;       // leading samples still to drop
+        uint64_t remaining = 0;  // samples still to take
+        uint64_t samples = 0;
+        Accumulator accumulators[kMaxWaveformLevels];
+        std::vector<WaveformBucket> levels[kMaxWaveformLevels];
+
+        void clear(Accumulator& acc);
+        void emit(uint32_t level, bool partial);
+
+    public:
+        WaveformBuilder(const WaveformConfig& config = WaveformConfig());
+
+        // starts a new stream: the first skip samples per channel are dropped
+        // (e.g. the encoder delay plus kDecoderDelay, so bucket 0 starts at
+        // the first stream sample) and at most length are used after that
+        void reset(uint64_t skip = 0, uint64_t length = UINT64_MAX);
+        // length samples of each channel in [-1, 1], as they leave synthesis
+        void addSamples(const float* const* in, uint32_t channels, uint32_t length, uint32_t rate);
+        // closes the last, partial buckets; call once after the last frame
+        void finish();
+
+        uint64_t numSamples() const { return samples; }
+        // bytes writeFile needs
+        size_t fileSize() const;
+        // the overview file; returns the bytes written or 0 if size < fileSize()
+        size_t writeFile(uint8_t* out, size_t size) const;
+    };
+
+    // the header of an overview file in memory (e.g. mmapped), or nullptr if
+    // it is not one or is truncated; buckets are read in place
+    const WaveformHeader* mapWaveform(const uint8_t* data, size_t size);
+    inline const WaveformBucket* waveformLevel(const WaveformHeader* header, uint32_t level) {
+        return (const WaveformBucket*)((const uint8_t*)header + header->levels[level].offset);
+    }
+
+}
+
+}
+
+}
+
+#endif  // INCLUDE_KERNEL_IO_WAVEFORM_H_